@@ -24,6 +24,7 @@ pvdumpTest_registerRecordDeviceDriver pdbbase
 
 ## Load our record instances
 #dbLoadRecords("db/xxx.db","user=faa59Host")
+dbLoadRecords("db/pvdump.db","P=$(MYPVPREFIX)CS:IOC:$(IOCNAME):PVDUMP:")
 
 ##ISIS## Stuff that needs to be done after all records are loaded but before iocInit is called 
 < $(IOCSTARTUP)/preiocinit.cmd
@@ -14,15 +14,22 @@
 #include <iostream>
 #include <map>
 #include <list>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <memory>
 #include <string>
 #include <time.h>
 #include <sstream>
+#include <iomanip>
 #include <fstream>
+#include <set>
 
 #include "epicsStdlib.h"
 #include "epicsString.h"
 #include "dbDefs.h"
 #include "epicsMutex.h"
+#include "epicsEvent.h"
 #include "epicsGuard.h"
 #include "dbBase.h"
 #include "dbStaticLib.h"
@@ -42,6 +49,10 @@
 #include "utilities.h"
 
 // mysql
+#ifdef PVDUMP_MYSQL_INT
+// go via the pvdump_mysql C interface, so e.g. the pvdump_mysqlmock library can stand in for MySQL
+#include "pvdump_mysql.h"
+#else
 #include <cppconn/driver.h>
 #include <cppconn/exception.h>
 #include <cppconn/warning.h>
@@ -52,6 +63,7 @@
 #include <cppconn/statement.h>
 #include "mysql_driver.h"
 #include "mysql_connection.h"
+#endif /* PVDUMP_MYSQL_INT */
 
 #ifdef _WIN32
 #include <process.h>
@@ -63,6 +75,12 @@
 #include <epicsExport.h>
 
 #include "pvdump.h"
+#include "pvdump_catalog.h"
+#include "pvdump_stats.h"
+#include "pvdump_status.h"
+#include "pvdump_spool.h"
+#include "pvdump_hostlock.h"
+#include "pvdump_sqlscript.h"
 
 static int get_pid()
 {
@@ -94,29 +112,209 @@ static std::string get_path()
     return std::string(buffer);
 }
 
-struct PVInfo
+static epicsMutex pv_map_mutex;
+static PVCatalog pv_map; ///< built up by pvdumpAddPV() and pvdumpAddPVInfo(), then published by pvdumpWritePVs()
+static PVCatalogPublisher pv_catalog; ///< the catalog most recently scanned or written, not valid() after a stream scan
+static std::list<std::string> environ_list;
+static double live_interval = -1.0; ///< set by pvdumpSetLiveInterval(), if negative PVDUMP_LIVE_INTERVAL is used
+static bool live_active = false; ///< pv_map changes are being logged, guarded by pv_map_mutex
+static std::set<std::string> live_changes; ///< PVs added, changed or removed since last written, guarded by pv_map_mutex
+
+static epicsMutex run_info_mutex;
+static pvdumpRunInfo run_info; ///< the most recent pvdump, see pvdumpGetRunInfo()
+static bool have_run_info = false;
+static unsigned long run_seq = 0; ///< incremented for each pvdump, results from a pvdump since superseded are ignored
+static epicsEvent run_info_event; ///< signalled when a pvdump finishes, see pvdumpWait()
+
+// seconds of wall clock time since start
+static double elapsedSince(const epicsTime& start)
+{
+    return epicsTime::getCurrent() - start;
+}
+
+static std::string ioc_name, db_name;    
+
+// records of pvdump.db are named PVDUMP_STATUS_PREFIX + e.g. "STATUS", by default $(MYPVPREFIX)CS:IOC:<ioc name>:PVDUMP:
+static std::string statusPrefix()
+{
+    const char* prefix = getenv("PVDUMP_STATUS_PREFIX");
+    if (prefix != NULL && *prefix != '\0')
+    {
+        return prefix;
+    }
+    const char* mypvprefix = getenv("MYPVPREFIX");
+    return std::string(mypvprefix != NULL ? mypvprefix : "") + "CS:IOC:" + ioc_name + ":PVDUMP:";
+}
+
+// start a new pvdump, returning its sequence number
+static unsigned long startRunInfo()
+{
+    unsigned long seq;
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        memset(&run_info, 0, sizeof(run_info));
+        have_run_info = true;
+        seq = ++run_seq;
+    }
+    PvdumpStatus::instance().setPrefix(statusPrefix());
+    PvdumpStatus::instance().started();
+    return seq;
+}
+
+static void finishRunInfo(unsigned long seq, int status)
+{
+    unsigned long rows;
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        if (seq != run_seq)
+        {
+            return;
+        }
+        run_info.status = status;
+        run_info.complete = 1;
+        rows = run_info.npv_written + run_info.ninfo_written + run_info.nmacro;
+    }
+    PvdumpStatus::instance().finished(status == 0, rows);
+    run_info_event.signal();
+}
+
+// return an integer setting from the environment, or default_value if not set or invalid
+static int getEnvInt(const char* name, int default_value)
+{
+    const char* str = getenv(name);
+    epicsInt32 value;
+    if (str == NULL || *str == '\0')
+    {
+        return default_value;
+    }
+    if (epicsParseInt32(str, &value, 10, NULL) != 0)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: ignoring invalid value \"%s\" for %s\n", str, name);
+        return default_value;
+    }
+    return value;
+}
+
+// add the current record of pdbentry, with its DESC and info fields, to pvs
+static void add_record(DBENTRY* pdbentry, PVCatalog& pvs)
+{
+    const char* recordName = dbGetRecordName(pdbentry);
+    const char* recordType = dbGetRecordTypeName(pdbentry);
+    const char* recordDesc = "";
+    if (dbFindField(pdbentry, "DESC") == 0)
+    {
+        recordDesc = dbGetString(pdbentry);
+    }
+    pvs.addPV(recordName, recordType, recordDesc);
+	long status = dbFirstInfo(pdbentry);
+	while(!status)
+	{
+	    const char* info_name = dbGetInfoName(pdbentry);
+		if (info_name != NULL)
+		{
+			const char* info_value = dbGetInfoString(pdbentry);
+			pvs.addInfo(recordName, info_name, (info_value != NULL ? info_value : "<error>"));
+		}
+		else
+		{
+			printf("dbFirst/NextInfo() OK, but dbGetInfoName() returns NULL\n");
+		}
+	    status = dbNextInfo(pdbentry);
+	}
+}
+
+/// a share of the record types for a parallel scan, each worker has its own DBENTRY
+struct ScanWorker
 {
-    std::string record_type;
-    std::string record_desc;
-    std::map<std::string,std::string> info_fields;
-	PVInfo(const std::string& rt, const std::string& rd, const std::map<std::string,std::string>& inf) : 
-        record_type(rt), record_desc(rd), info_fields(inf) { }
-	PVInfo(const std::string& rt, const std::string& rd) : 
-        record_type(rt), record_desc(rd) { }
-	PVInfo() { }
+    std::vector<std::string> record_types;
+    long nrecords; ///< total records in record_types, used to balance the work
+    PVCatalog results;
+    epicsEvent done;
+    ScanWorker() : nrecords(0) { }
 };
 
-static epicsMutex pv_map_mutex;
-static std::map<std::string,PVInfo> pv_map;
-static std::list<std::string> environ_list;
+static void scanWorkerThread(void* arg)
+{
+    ScanWorker* worker = static_cast<ScanWorker*>(arg);
+    DBENTRY dbentry;
+    DBENTRY *pdbentry=&dbentry;
+    worker->results.reserve(worker->nrecords, worker->nrecords, worker->nrecords * 64);
+    dbInitEntry(pdbbase, pdbentry);
+    for(size_t i = 0; i < worker->record_types.size(); ++i)
+    {
+        if (dbFindRecordType(pdbentry, worker->record_types[i].c_str()) != 0)
+        {
+            continue;
+        }
+        long status = dbFirstRecord(pdbentry);
+        while (!status) {
+            add_record(pdbentry, worker->results);
+            status = dbNextRecord(pdbentry);
+        }
+    }
+    dbFinishEntry(pdbentry);
+    worker->results.finalize();
+    worker->done.signal();
+}
+
+// scan all record types split across nthreads worker threads. Record types are dealt out largest first to the
+// least loaded worker. Results are merged into pvs, which is ordered by name regardless of which
+// worker scanned a record, so the output is the same as a sequential scan.
+static void dump_pvs_parallel(int nthreads, PVCatalog& pvs)
+{
+    DBENTRY dbentry;
+    DBENTRY *pdbentry=&dbentry;
+    std::vector< std::pair<long,std::string> > types;
+    dbInitEntry(pdbbase, pdbentry);
+    long status = dbFirstRecordType(pdbentry);
+    while (!status) {
+        types.push_back(std::make_pair(dbGetNRecords(pdbentry), std::string(dbGetRecordTypeName(pdbentry))));
+        status = dbNextRecordType(pdbentry);
+    }
+    dbFinishEntry(pdbentry);
+    std::sort(types.rbegin(), types.rend());
+    std::vector<ScanWorker*> workers;
+    for(int j = 0; j < nthreads; ++j)
+    {
+        workers.push_back(new ScanWorker);
+    }
+    for(size_t i = 0; i < types.size(); ++i)
+    {
+        ScanWorker* least = workers[0];
+        for(size_t j = 1; j < workers.size(); ++j)
+        {
+            if (workers[j]->nrecords < least->nrecords)
+            {
+                least = workers[j];
+            }
+        }
+        least->record_types.push_back(types[i].second);
+        least->nrecords += types[i].first;
+    }
+    for(size_t j = 0; j < workers.size(); ++j)
+    {
+        if (epicsThreadCreate("pvdumpScan", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                              scanWorkerThread, workers[j]) == 0)
+        {
+            scanWorkerThread(workers[j]); // do it ourselves
+        }
+    }
+    for(size_t j = 0; j < workers.size(); ++j)
+    {
+        workers[j]->done.wait();
+        pvs.append(workers[j]->results);
+        delete workers[j];
+    }
+    pvs.finalize();
+}
 
 // based on iocsh dbl command from epics_base/src/db/dbTest.c 
-// return an std map, currently key is pv and value is recordType (if that is defined)
-static void dump_pvs(const char *precordTypename, const char *fields, std::map<std::string,PVInfo>& pvs)
+// return a catalog of pv name, recordType, DESC and info fields
+static void dump_pvs(const char *precordTypename, const char *fields, PVCatalog& pvs)
 {
     DBENTRY dbentry;
     DBENTRY *pdbentry=&dbentry;
-    long status, status2;
+    long status;
     int nfields = 0;
     int ifield;
     char *fieldnames = 0;
@@ -131,6 +329,11 @@ static void dump_pvs(const char *precordTypename, const char *fields, std::map<s
         precordTypename = NULL;
     if (fields && (*fields == '\0'))
         fields = NULL;
+    const int nthreads = getEnvInt("PVDUMP_SCAN_THREADS", 1);
+    if (!precordTypename && !fields && nthreads > 1) {
+        dump_pvs_parallel(nthreads, pvs);
+        return;
+    }
     if (fields) {
         char *pnext;
 
@@ -160,7 +363,6 @@ static void dump_pvs(const char *precordTypename, const char *fields, std::map<s
     if (status) {
         printf("No record type\n");
     }
-	std::map<std::string,std::string> info_fields;
     while (!status) {
         status = dbFirstRecord(pdbentry);
         while (!status) {
@@ -177,30 +379,7 @@ static void dump_pvs(const char *precordTypename, const char *fields, std::map<s
                     pvalue = dbGetString(pdbentry);
                 }
             }
-            const char* recordType = dbGetRecordTypeName(pdbentry);
-            const char* recordDesc = "";
-            if (dbFindField(pdbentry, "DESC") == 0)
-            {
-                recordDesc = dbGetString(pdbentry);
-            }
-			// info fields
-			info_fields.clear();
-			status2 = dbFirstInfo(pdbentry);
-			while(!status2)
-			{
-			    const char* info_name = dbGetInfoName(pdbentry);
-				if (info_name != NULL)
-				{
-					const char* info_value = dbGetInfoString(pdbentry);
-					info_fields[info_name] = (info_value != NULL ? info_value : "<error>");
-				}
-				else
-				{
-					printf("dbFirst/NextInfo() OK, but dbGetInfoName() returns NULL\n");
-				}
-			    status2 = dbNextInfo(pdbentry);
-			}
-			pvs[dbGetRecordName(pdbentry)] = PVInfo(recordType, recordDesc, info_fields);
+            add_record(pdbentry, pvs);
             status = dbNextRecord(pdbentry);
         }
         if (precordTypename) break;
@@ -211,190 +390,2514 @@ static void dump_pvs(const char *precordTypename, const char *fields, std::map<s
         free((void *)fieldnames);
     }
     dbFinishEntry(pdbentry);
+    pvs.finalize();
+}
+
+#ifndef PVDUMP_DUMMY
+/// Finalized chunks of a scan on their way to the writer. push() waits while the queue is full, so the scan
+/// never gets more than max_chunks ahead of the database writes and memory use does not grow with the IOC.
+class PVChunkQueue
+{
+public:
+    explicit PVChunkQueue(size_t max_chunks) : m_max_chunks(max_chunks > 0 ? max_chunks : 1), m_closed(false), m_aborted(false) { }
+    ~PVChunkQueue()
+    {
+        for(size_t i = 0; i < m_chunks.size(); ++i)
+        {
+            delete m_chunks[i];
+        }
+    }
+    /// queue a chunk, which we now own. Returns false, deleting the chunk, if the reader has given up
+    bool push(PVCatalog* chunk)
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        while(m_chunks.size() >= m_max_chunks && !m_aborted)
+        {
+            epicsGuardRelease<epicsMutex> _unlock(_lock);
+            m_not_full.wait();
+        }
+        if (m_aborted)
+        {
+            delete chunk;
+            return false;
+        }
+        m_chunks.push_back(chunk);
+        m_not_empty.signal();
+        return true;
+    }
+    /// the next chunk, which the caller then owns, or NULL once the scan has finished
+    PVCatalog* pop()
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        while(m_chunks.empty() && !m_closed)
+        {
+            epicsGuardRelease<epicsMutex> _unlock(_lock);
+            m_not_empty.wait();
+        }
+        if (m_chunks.empty())
+        {
+            return NULL;
+        }
+        PVCatalog* chunk = m_chunks.front();
+        m_chunks.pop_front();
+        m_not_full.signal();
+        return chunk;
+    }
+    /// no more chunks will be pushed
+    void close()
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        m_closed = true;
+        m_not_empty.signal();
+    }
+    /// the reader has given up, push() fails from now on
+    void abort()
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        m_aborted = true;
+        m_not_full.signal();
+    }
+private:
+    epicsMutex m_lock;
+    epicsEvent m_not_full;
+    epicsEvent m_not_empty;
+    std::deque<PVCatalog*> m_chunks;
+    const size_t m_max_chunks;
+    bool m_closed;
+    bool m_aborted;
+};
+
+/// a scan of all records in chunks of chunk_rows PVs, run on its own thread while the writer sends the chunks
+struct StreamScan
+{
+    PVChunkQueue queue;
+    const size_t chunk_rows;
+    unsigned long npv;
+    unsigned long ninfo;
+    double scan_time;
+    std::string error; ///< set if the scan failed
+    epicsEvent done;
+    StreamScan(size_t max_chunks, size_t chunk_rows_) : queue(max_chunks), chunk_rows(chunk_rows_ > 0 ? chunk_rows_ : 1), npv(0), ninfo(0), scan_time(0.0) { }
+};
+
+// finalize a chunk and queue it, returns false if the writer has given up
+static bool pushChunk(StreamScan* scan, std::auto_ptr<PVCatalog>& chunk)
+{
+    chunk->finalize();
+    scan->npv += static_cast<unsigned long>(chunk->size());
+    scan->ninfo += static_cast<unsigned long>(chunk->infoCount());
+    return scan->queue.push(chunk.release());
+}
+
+static void streamScanThread(void* arg)
+{
+    StreamScan* scan = static_cast<StreamScan*>(arg);
+    const epicsTime start = epicsTime::getCurrent();
+    DBENTRY dbentry;
+    DBENTRY *pdbentry=&dbentry;
+    dbInitEntry(pdbbase, pdbentry);
+    try
+    {
+        std::auto_ptr<PVCatalog> chunk;
+        bool writing = true;
+        long status = dbFirstRecordType(pdbentry);
+        while (!status && writing) {
+            status = dbFirstRecord(pdbentry);
+            while (!status && writing) {
+                if (chunk.get() == NULL)
+                {
+                    chunk.reset(new PVCatalog);
+                    chunk->reserve(scan->chunk_rows, scan->chunk_rows, scan->chunk_rows * 64);
+                }
+                add_record(pdbentry, *chunk);
+                if (chunk->size() >= scan->chunk_rows)
+                {
+                    writing = pushChunk(scan, chunk);
+                }
+                status = dbNextRecord(pdbentry);
+            }
+            status = dbNextRecordType(pdbentry);
+        }
+        if (writing && chunk.get() != NULL)
+        {
+            pushChunk(scan, chunk);
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        scan->error = ex.what();
+    }
+    dbFinishEntry(pdbentry);
+    scan->scan_time = elapsedSince(start);
+    scan->queue.close();
+    scan->done.signal();
 }
 
+/// stops the scan and waits for its thread, however the writer leaves
+class StreamScanGuard
+{
+    StreamScan& m_scan;
+public:
+    explicit StreamScanGuard(StreamScan& scan) : m_scan(scan) { }
+    ~StreamScanGuard()
+    {
+        m_scan.queue.abort();
+        m_scan.done.wait();
+    }
+};
+#endif /* PVDUMP_DUMMY */
+
 static void pvdumpOnExit(void*);
 
-static std::string ioc_name, db_name;    
+static std::string load_mode; // "insert" or "bulk" if set by pvdump or pvdumpSetLoadMode, otherwise PVDUMP_LOAD is used
 static sql::Driver* mysql_driver = NULL;
 
 static const int MAX_MACRO_VAL_LENGTH = 100; // should agree with length of macroval in iocenv MySQL table (iocdb_mysql_schema.txt)
 static const int MAX_INFO_VAL_LENGTH = 100; // should agree with length of value in pvinfo MySQL table (iocdb_mysql_schema.txt)
 static const int MAX_IOC_PATH_LENGTH = 100; // should agree with length of exe_path in iocrt and exe/dir in iocs MySQL table (iocdb_mysql_schema.txt)
 
-struct MysqlThreadArgs
+static const int DEFAULT_BATCH_ROWS = 500; // rows per multi-row INSERT, 1 gives the old one statement per row behaviour
+static const int DEFAULT_BATCH_BYTES = 1000000; // keep well under the server max_allowed_packet (4MB on older MySQL)
+static const int MAX_PLACEHOLDERS = 65535; // MySQL limit on parameter markers in one prepared statement
+
+int pvdumpBatchRows = 0; // if > 0 overrides PVDUMP_BATCH_ROWS environment variable, set via iocsh "var"
+int pvdumpBatchBytes = 0; // if > 0 overrides PVDUMP_BATCH_BYTES environment variable, set via iocsh "var"
+
+// return a string setting from the environment, or default_value if not set
+static std::string getEnvString(const char* name, const char* default_value)
 {
-    const std::map<std::string,PVInfo>& pvm;
-    const std::list<std::string>& evl;
-    std::string mysql_host;
-    MysqlThreadArgs(const std::map<std::string,PVInfo>& pvm_,
-                    const std::list<std::string>& evl_,
-                    const std::string& mysql_host_) : pvm(pvm_), evl(evl_), mysql_host(mysql_host_) { }
-};
+    const char* str = getenv(name);
+    return ( (str != NULL && *str != '\0') ? str : default_value );
+}
+
+// an iocsh variable takes precedence over the environment variable 
+static int getSetting(int iocsh_value, const char* env_name, int default_value)
+{
+    return (iocsh_value > 0 ? iocsh_value : getEnvInt(env_name, default_value));
+}
 
-static void dumpMysqlThread(void* arg)
+// seconds to collect changes made after a pvdump for before writing them, 0 if they are not written
+static double liveInterval()
 {
-	unsigned long npv = 0, ninfo = 0, nmacro = 0;
-    MysqlThreadArgs* marg = (MysqlThreadArgs*)arg;
-	const char* mysqlHost = marg->mysql_host.c_str();
+    return (live_interval >= 0.0 ? live_interval : atof(getEnvString("PVDUMP_LIVE_INTERVAL", "0").c_str()));
+}
+
 #ifndef PVDUMP_DUMMY
-	try 
-	{
-        const clock_t begin_time = clock();
-        std::auto_ptr< sql::Connection > con(mysql_driver->connect(mysqlHost, "iocdb", "$iocdb"));
-    // the ORDER BY is to make deletes happen in a consistent primary key order, and so try and avoid deadlocks
-    // but it may not be completely right. Additional indexes have also been added to database tables.
-	    con->setAutoCommit(0); // we will create transactions ourselves via explicit calls to con->commit()
-	    con->setSchema("iocdb");
-        // use DELETE and INSERT on pvs table as we may have the same pv name from a different IOC e.g. CAENSIM and CAEN
-		std::auto_ptr< sql::PreparedStatement > pvs_dstmt(con->prepareStatement("DELETE FROM pvs WHERE pvname=?"));
-        for(std::map<std::string,PVInfo>::const_iterator it = pv_map.begin(); it != pv_map.end(); ++it)
-        {
-            pvs_dstmt->setString(1, it->first);
-			pvs_dstmt->executeUpdate();
-        }
-		con->commit();
-        
-		std::auto_ptr< sql::PreparedStatement > pvs_stmt(con->prepareStatement("INSERT INTO pvs (pvname, record_type, record_desc, iocname) VALUES (?,?,?,?)"));
-		std::auto_ptr< sql::PreparedStatement > pvinfo_stmt(con->prepareStatement("INSERT INTO pvinfo (pvname, infoname, value) VALUES (?,?,?)"));
-        for(std::map<std::string,PVInfo>::const_iterator it = pv_map.begin(); it != pv_map.end(); ++it)
-        {
-			++npv;
-            pvs_stmt->setString(1, it->first);
-            pvs_stmt->setString(2, it->second.record_type);
-            pvs_stmt->setString(3, it->second.record_desc);
-            pvs_stmt->setString(4, ioc_name);
-			pvs_stmt->executeUpdate();
-			const std::map<std::string,std::string>& imap = it->second.info_fields;
-            for(std::map<std::string,std::string>::const_iterator itinf = imap.begin(); itinf != imap.end(); ++itinf)
-			{
-				++ninfo;
-			    pvinfo_stmt->setString(1, it->first);
-			    pvinfo_stmt->setString(2, itinf->first);
-			    pvinfo_stmt->setString(3, itinf->second.substr(0, MAX_INFO_VAL_LENGTH));
-				pvinfo_stmt->executeUpdate();
-			}
+static const int DEFAULT_POOL_SIZE = 2; // idle connections kept, enough for the iocsh thread and the writer thread
+static const size_t MAX_CACHED_STATEMENTS = 64;
+// network timeouts in seconds, overridden by PVDUMP_CONNECT_TIMEOUT etc. with 0 meaning the client library default.
+// The client library retries a read, so a read can take up to three times the read timeout to fail.
+static const int DEFAULT_CONNECT_TIMEOUT = 10;
+static const int DEFAULT_READ_TIMEOUT = 120;
+static const int DEFAULT_WRITE_TIMEOUT = 120;
+static const int DEFAULT_EXIT_TIMEOUT = 5; // seconds the exit handler will wait for the iocrt update
+static const int DEFAULT_STREAM_CHUNK = 5000; // PVs per chunk when PVDUMP_SCAN=stream
+static const int DEFAULT_STREAM_QUEUE = 4; // chunks the scan may get ahead of the writer
+static const int DEFAULT_SHARD_ATTEMPTS = 3; // tries at writing each shard when PVDUMP_SHARDS > 1
+static const int DEFAULT_COMMIT_ROWS = 5000; // PVs, with their info fields, inserted per transaction
+static const int DEFAULT_LOCK_ATTEMPTS = 5; // tries at a chunk that hits a deadlock or lock wait timeout
+static const double LOCK_RETRY_DELAY = 0.05; // seconds before the first retry of a chunk, doubled for each further retry
+static const double MAX_LOCK_RETRY_DELAY = 5.0;
+static const int ER_LOCK_WAIT_TIMEOUT = 1205; // MySQL server error codes
+static const int ER_LOCK_DEADLOCK = 1213;
+static const int DEFAULT_ADMISSION_TIMEOUT = 600; // seconds to wait for a host or fleet slot before writing anyway
+static const double ADMISSION_POLL = 1.0; // average seconds between attempts at a slot
+static const double START_DELAY_PVS = 10000.0; // PVDUMP_START_DELAY is the delay per this many PVs
+static const double MIN_SPOOL_RETRY = 1.0; // seconds, lower PVDUMP_SPOOL_RETRY values would have the writer spin
+
+static bool bulkLoadEnabled();
+
+// execute statements recording their wall clock time, by statement type, in the pvdump statistics
+static void timedExecuteUpdate(sql::PreparedStatement* pstmt, const std::string& type)
+{
+    PvdumpStatementTimer timer(type);
+    pstmt->executeUpdate();
+}
+
+/// bind values to the parameters of pstmt in order and execute it. Via the pvdump_mysql interface this is
+/// one call rather than one per parameter
+static void timedExecuteUpdate(sql::PreparedStatement* pstmt, const std::vector<std::string>& values, const std::string& type)
+{
+#ifdef PVDUMP_MYSQL_INT
+    std::vector<const char*> ptrs(values.size());
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+        ptrs[i] = values[i].c_str();
+    }
+    PvdumpStatementTimer timer(type);
+    pstmt->executeBatch(1, static_cast<int>(ptrs.size()), (ptrs.empty() ? NULL : &(ptrs[0])));
+#else
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+        pstmt->setString(static_cast<unsigned>(i + 1), values[i]);
+    }
+    timedExecuteUpdate(pstmt, type);
+#endif /* PVDUMP_MYSQL_INT */
+}
+
+static sql::ResultSet* timedExecuteQuery(sql::PreparedStatement* pstmt, const std::string& type)
+{
+    PvdumpStatementTimer timer(type);
+    return pstmt->executeQuery();
+}
+
+static void timedExecute(sql::Statement* stmt, const std::string& sql)
+{
+    PvdumpStatementTimer timer(PvdumpStats::statementType(sql));
+    stmt->execute(sql);
+    PvdumpStatus::instance().addBytes(sql.size());
+}
+
+static sql::ResultSet* timedExecuteQuery(sql::Statement* stmt, const std::string& sql)
+{
+    PvdumpStatementTimer timer(PvdumpStats::statementType(sql));
+    return stmt->executeQuery(sql);
+}
+
+/// An authenticated connection to the iocdb schema, with autocommit off, plus a cache of prepared
+/// statements keyed by SQL text. Cached statements are owned by the connection and must not be deleted.
+class PvdumpConnection
+{
+    sql::Connection* m_con;
+    std::map<std::string, sql::PreparedStatement*> m_stmts;
+    std::string m_host;
+    bool m_local_infile; ///< connected allowing LOAD DATA LOCAL INFILE
+    
+    void clearStatements()
+    {
+        for(std::map<std::string, sql::PreparedStatement*>::iterator it = m_stmts.begin(); it != m_stmts.end(); ++it)
+        {
+            delete it->second;
+        }
+        m_stmts.clear();
+    }
+    
+public:
+    explicit PvdumpConnection(const std::string& host) : m_con(NULL), m_host(host), m_local_infile(bulkLoadEnabled())
+    {
+        PvdumpPhaseTimer timer("connect");
+        if (mysql_driver == NULL)
+        {
+	        mysql_driver = sql::mysql::get_driver_instance();
+        }
+        sql::ConnectOptionsMap options;
+        options["hostName"] = host;
+        options["userName"] = "iocdb";
+        options["password"] = "$iocdb";
+        if (m_local_infile)
+        {
+            options["OPT_LOCAL_INFILE"] = 1; // for LOAD DATA LOCAL INFILE
+        }
+        // without these an unreachable server can hold us for the operating system TCP timeout
+        const int connect_timeout = getEnvInt("PVDUMP_CONNECT_TIMEOUT", DEFAULT_CONNECT_TIMEOUT);
+        const int read_timeout = getEnvInt("PVDUMP_READ_TIMEOUT", DEFAULT_READ_TIMEOUT);
+        const int write_timeout = getEnvInt("PVDUMP_WRITE_TIMEOUT", DEFAULT_WRITE_TIMEOUT);
+        if (connect_timeout > 0)
+        {
+            options["OPT_CONNECT_TIMEOUT"] = connect_timeout;
+        }
+        if (read_timeout > 0)
+        {
+            options["OPT_READ_TIMEOUT"] = read_timeout;
         }
-		con->commit();
+        if (write_timeout > 0)
+        {
+            options["OPT_WRITE_TIMEOUT"] = write_timeout;
+        }
+        m_con = mysql_driver->connect(options);
+        try
+        {
+            // the ORDER BY is to make deletes happen in a consistent primary key order, and so try and avoid deadlocks
+            // but it may not be completely right. Additional indexes have also been added to database tables.
+	        m_con->setAutoCommit(0); // we will create transactions ourselves via explicit calls to con->commit()
+	        m_con->setSchema("iocdb");
+        }
+        catch(...)
+        {
+            delete m_con;
+            throw;
+        }
+    }
+    
+    ~PvdumpConnection()
+    {
+        clearStatements();
+        delete m_con;
+    }
+    
+    sql::Connection* operator->() { return m_con; }
+    
+    const std::string& host() const { return m_host; }
+
+    bool localInfile() const { return m_local_infile; }
+
+    void commit()
+    {
+        PvdumpStatementTimer timer("COMMIT");
+        m_con->commit();
+    }
 
-		std::auto_ptr< sql::PreparedStatement > iocenv_stmt(con->prepareStatement("INSERT INTO iocenv (iocname, macroname, macroval) VALUES (?,?,?)"));
-		iocenv_stmt->setString(1, ioc_name);
-        for(std::list<std::string>::const_iterator it = environ_list.begin(); it != environ_list.end(); ++it)
+    /// return a cached prepared statement for sql, creating it if needed
+    sql::PreparedStatement* prepare(const std::string& sql)
+    {
+        std::map<std::string, sql::PreparedStatement*>::const_iterator it = m_stmts.find(sql);
+        if (it != m_stmts.end())
+        {
+            return it->second;
+        }
+        sql::PreparedStatement* pstmt = m_con->prepareStatement(sql);
+        m_stmts[sql] = pstmt;
+        return pstmt;
+    }
+    
+    /// check the server is still there, reconnecting if needed. Prepared statements do not survive a reconnect.
+    bool checkHealth()
+    {
+        try
         {
-            const std::string& s = *it;
-			size_t pos = s.find('=');
-            if (pos != std::string::npos)
+            if (m_con->isValid())
             {
-				if ( (s.size() - pos) < MAX_MACRO_VAL_LENGTH )  // ignore things with long values like PATH
-				{
-		            iocenv_stmt->setString(2, s.substr(0, pos).c_str()); // name
-		            iocenv_stmt->setString(3, s.substr(pos + 1).c_str()); // value
-			        iocenv_stmt->executeUpdate();
-				    ++nmacro;
-				}
-			}
-		}
-		con->commit();
+                return true;
+            }
+            clearStatements();
+            PvdumpStatus::instance().addRetry();
+            PvdumpPhaseTimer timer("reconnect");
+            if (m_con->reconnect())
+            {
+	            m_con->setAutoCommit(0);
+	            m_con->setSchema("iocdb");
+                return true;
+            }
+        }
+        catch(const std::exception&)
+        {
+        }
+        return false;
+    }
+    
+    /// called before going back in the pool, discard anything a failed caller left uncommitted
+    void reset()
+    {
+        m_con->rollback();
+        if (m_stmts.size() > MAX_CACHED_STATEMENTS)
+        {
+            clearStatements();
+        }
+    }
+};
 
-        std::cout << "pvdump: MySQL write of " << npv << " PVs with " << ninfo << " info entries, plus " << nmacro << " macros took " << float( clock () - begin_time ) /  CLOCKS_PER_SEC << " seconds" << std::endl;
-        delete marg;
+/// Keeps warm connections between pvdump operations so the boot, writer and exit paths do not each pay for a
+/// new TCP connection and authentication. A connection is only used by one thread at a time.
+class PvdumpConnectionPool
+{
+    epicsMutex m_lock;
+    std::list<PvdumpConnection*> m_idle;
+    
+public:
+    PvdumpConnection* acquire(const std::string& host)
+    {
+        while(true)
+        {
+            PvdumpConnection* pcon = NULL;
+            {
+                epicsGuard<epicsMutex> _lock(m_lock);
+                if (m_idle.empty())
+                {
+                    break;
+                }
+                pcon = m_idle.back();
+                m_idle.pop_back();
+            }
+            // local infile can only be allowed when connecting, so a connection made before bulk loads were
+            // selected is replaced
+            if (pcon->host() == host && (pcon->localInfile() || !bulkLoadEnabled()) && pcon->checkHealth())
+            {
+                return pcon;
+            }
+            delete pcon;
+        }
+        return new PvdumpConnection(host);
+    }
+    
+    void release(PvdumpConnection* pcon)
+    {
+        try
+        {
+            pcon->reset();
+        }
+        catch(const std::exception&)
+        {
+            delete pcon; // connection is broken
+            return;
+        }
+        const size_t max_idle = getEnvInt("PVDUMP_POOL_SIZE", DEFAULT_POOL_SIZE);
+        {
+            epicsGuard<epicsMutex> _lock(m_lock);
+            if (m_idle.size() < max_idle)
+            {
+                m_idle.push_back(pcon);
+                return;
+            }
+        }
+        delete pcon;
+    }
+    
+    static PvdumpConnectionPool& instance()
+    {
+        // deliberately never deleted, it may still be needed by exit handlers
+        static PvdumpConnectionPool* pool = new PvdumpConnectionPool;
+        return *pool;
+    }
+};
+
+/// borrow a connection from the pool for the lifetime of this object
+class PooledConnection
+{
+    PvdumpConnection* m_pcon;
+    PooledConnection(const PooledConnection&);
+    PooledConnection& operator=(const PooledConnection&);
+public:
+    explicit PooledConnection(const std::string& host) : m_pcon(PvdumpConnectionPool::instance().acquire(host)) { }
+    ~PooledConnection() { PvdumpConnectionPool::instance().release(m_pcon); }
+    PvdumpConnection& operator*() { return *m_pcon; }
+    sql::Connection* operator->() { return m_pcon->operator->(); }
+    sql::PreparedStatement* prepare(const std::string& sql) { return m_pcon->prepare(sql); }
+    void commit() { m_pcon->commit(); }
+};
+
+// a random number in [0,1), seeded differently in each process so IOCs booting together do not retry in step
+static double randomFraction()
+{
+    static epicsMutex random_mutex;
+    static epicsUInt64 state = 0;
+    epicsGuard<epicsMutex> _lock(random_mutex);
+    if (state == 0)
+    {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        state = ((static_cast<epicsUInt64>(now.secPastEpoch) << 32) ^ now.nsec ^ (static_cast<epicsUInt64>(get_pid()) << 16)) | 1;
+    }
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<double>(state >> 11) / 9007199254740992.0; // 2^53
+}
+
+// Called when a chunk's transaction fails. After a deadlock or lock wait timeout, roll back, wait a random time
+// for the other transaction to finish and return true to have the caller try the chunk again. Otherwise,
+// or once PVDUMP_LOCK_ATTEMPTS tries have been made, return false for the caller to rethrow.
+static bool retryAfterLockError(PvdumpConnection& con, const sql::SQLException& e, int attempt, const char* what)
+{
+    const int code = e.getErrorCode();
+    if (code != ER_LOCK_DEADLOCK && code != ER_LOCK_WAIT_TIMEOUT)
+    {
+        return false;
+    }
+    const int max_attempts = getEnvInt("PVDUMP_LOCK_ATTEMPTS", DEFAULT_LOCK_ATTEMPTS);
+    const char* reason = (code == ER_LOCK_DEADLOCK ? "deadlock" : "lock wait timeout");
+    if (attempt >= max_attempts)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: %s failed after %d attempts, last with %s\n", what, attempt, reason);
+        return false;
+    }
+    con->rollback();
+    const double delay = std::min(LOCK_RETRY_DELAY * static_cast<double>(1 << std::min(attempt - 1, 16)), MAX_LOCK_RETRY_DELAY) * (0.5 + randomFraction());
+    errlogSevPrintf(errlogMinor, "pvdump: %s %s, retrying in %.3f seconds (attempt %d of %d)\n", what, reason, delay, attempt + 1, max_attempts);
+    PvdumpStatus::instance().addLockRetry();
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        ++run_info.lock_retries;
+    }
+    epicsThreadSleep(delay);
+    return true;
+}
+
+/// Accumulates rows for a table and writes them with multi-row "INSERT ... VALUES (?,?),(?,?),..."
+/// statements, sending a batch when either the row or byte limit is reached. Prepared statements
+/// are kept per batch size so normally only the full batch and final partial batch get prepared, the
+/// full batch statement is cached on the connection for reuse by later dumps.
+class BatchInserter
+{
+    PvdumpConnection& m_con;
+    std::string m_prefix; // "INSERT INTO table (col1,col2)"
+    std::string m_suffix; // anything to append after the VALUES list
+    std::string m_type; // statement type for timing statistics
+    int m_ncols;
+    size_t m_max_rows;
+    size_t m_max_bytes;
+    std::vector<std::string> m_values; // m_ncols entries per pending row
+    size_t m_bytes;
+    unsigned long m_nrows;
+    unsigned long m_nstatements;
+    std::map<size_t, sql::PreparedStatement*> m_stmts; // partial batches, owned by us
+    
+    sql::PreparedStatement* getStatement(size_t nrows)
+    {
+        std::map<size_t, sql::PreparedStatement*>::const_iterator it = m_stmts.find(nrows);
+        if (it != m_stmts.end())
+        {
+            return it->second;
+        }
+        std::string row("(");
+        for(int i = 0; i < m_ncols; ++i)
+        {
+            row += (i == 0 ? "?" : ",?");
+        }
+        row += ")";
+        std::string sql(m_prefix);
+        sql.reserve(m_prefix.size() + m_suffix.size() + nrows * (row.size() + 1) + 8);
+        sql += " VALUES ";
+        for(size_t i = 0; i < nrows; ++i)
+        {
+            if (i > 0)
+            {
+                sql += ',';
+            }
+            sql += row;
+        }
+        sql += m_suffix;
+        if (nrows == m_max_rows)
+        {
+            return m_con.prepare(sql);
+        }
+        sql::PreparedStatement* pstmt = m_con->prepareStatement(sql);
+        m_stmts[nrows] = pstmt;
+        return pstmt;
+    }
+    
+public:
+    BatchInserter(PvdumpConnection& con, const std::string& prefix, int ncols, size_t max_rows, size_t max_bytes, const std::string& suffix = "") :
+        m_con(con), m_prefix(prefix), m_suffix(suffix), m_type(PvdumpStats::statementType(prefix)), m_ncols(ncols), m_max_rows(max_rows), m_max_bytes(max_bytes),
+        m_bytes(0), m_nrows(0), m_nstatements(0)
+    {
+        if (m_max_rows < 1)
+        {
+            m_max_rows = 1;
+        }
+        if (m_max_rows * m_ncols > MAX_PLACEHOLDERS)
+        {
+            m_max_rows = MAX_PLACEHOLDERS / m_ncols;
+        }
+        m_values.reserve(m_max_rows * m_ncols);
+    }
+    
+    ~BatchInserter()
+    {
+        for(std::map<size_t, sql::PreparedStatement*>::iterator it = m_stmts.begin(); it != m_stmts.end(); ++it)
+        {
+            delete it->second;
+        }
+    }
+    
+    /// add a row, values points to m_ncols strings 
+    void addRow(const std::string* values)
+    {
+        size_t row_bytes = 0;
+        for(int i = 0; i < m_ncols; ++i)
+        {
+            row_bytes += values[i].size() + 4;  // allow for quoting/separators on the wire
+        }
+        if ( !m_values.empty() && (m_bytes + row_bytes > m_max_bytes) )
+        {
+            flush();
+        }
+        m_values.insert(m_values.end(), values, values + m_ncols);
+        m_bytes += row_bytes;
+        if (m_values.size() >= m_max_rows * m_ncols)
+        {
+            flush();
+        }
+    }
+    
+    void addRow(const std::string& v1, const std::string& v2, const std::string& v3)
+    {
+        const std::string values[3] = { v1, v2, v3 };
+        addRow(values);
+    }
+
+    void addRow(const std::string& v1, const std::string& v2, const std::string& v3, const std::string& v4)
+    {
+        const std::string values[4] = { v1, v2, v3, v4 };
+        addRow(values);
+    }
+    
+    /// send any pending rows
+    void flush()
+    {
+        if (m_values.empty())
+        {
+            return;
+        }
+        size_t nrows = m_values.size() / m_ncols;
+        sql::PreparedStatement* pstmt = getStatement(nrows);
+        timedExecuteUpdate(pstmt, m_values, m_type);
+        PvdumpStatus::instance().addBytes(m_bytes);
+        m_nrows += static_cast<unsigned long>(nrows);
+        ++m_nstatements;
+        m_values.clear();
+        m_bytes = 0;
+    }
+    
+    unsigned long rows() const { return m_nrows; }
+    unsigned long statements() const { return m_nstatements; }
+};
+
+/// how PVs with the same name as ours, but registered by a different IOC, are removed before insert
+enum CleanupStrategy
+{
+    CleanupPerRow,   ///< one "DELETE FROM pvs WHERE pvname=? AND iocname<>?" per PV (original behaviour)
+    CleanupInList,   ///< chunked "DELETE FROM pvs WHERE pvname IN (?,?,...) AND iocname<>?"
+    CleanupTempTable ///< bulk load names into a session temporary table, then one join-delete per chunk
+};
+
+static CleanupStrategy getCleanupStrategy()
+{
+    std::string mode = getEnvString("PVDUMP_CLEANUP", "row");
+    if (mode == "row")
+    {
+        return CleanupPerRow;
+    }
+    else if (mode == "in")
+    {
+        return CleanupInList;
+    }
+    else if (mode == "temp")
+    {
+        return CleanupTempTable;
+    }
+    errlogSevPrintf(errlogMinor, "pvdump: unknown PVDUMP_CLEANUP mode \"%s\" (expected row, in or temp), using row\n", mode.c_str());
+    return CleanupPerRow;
+}
+
+static const char* cleanupStrategyName(CleanupStrategy strategy)
+{
+    switch(strategy)
+    {
+        case CleanupInList:
+            return "in";
+        case CleanupTempTable:
+            return "temp";
+        default:
+            return "row";
+    }
+}
+
+// "DELETE FROM pvs WHERE pvname IN (?,?,...) AND iocname<>?" with nnames + 1 parameters, or iocname=? if own
+static std::string inListDeleteSQL(size_t nnames, bool own = false)
+{
+    std::string sql("DELETE FROM pvs WHERE pvname IN (");
+    sql.reserve(sql.size() + 2 * nnames + 16);
+    for(size_t i = 0; i < nnames; ++i)
+    {
+        sql += (i == 0 ? "?" : ",?");
+    }
+    sql += (own ? ") AND iocname=?" : ") AND iocname<>?");
+    return sql;
+}
+
+// remove any PVs in pvm registered from a different IOC e.g. CAENSIM and CAEN, our own PVs are either already
+// removed by iocname in dumpMysql() or are left to be updated in place. pvm is sorted, so chunks delete in a
+// consistent primary key order.
+// Each chunk is committed separately to keep lock hold times short.
+static void deleteDuplicatePVs(PvdumpConnection& con, const PVCatalog& pvm, CleanupStrategy strategy, size_t chunk_rows)
+{
+    PvdumpPhaseTimer timer("cleanup");
+    const epicsTime begin_time = epicsTime::getCurrent();
+    double load_time = 0.0;
+    unsigned long nchunks = 0;
+    if (chunk_rows < 1)
+    {
+        chunk_rows = 1;
+    }
+    if (strategy == CleanupPerRow)
+    {
+		sql::PreparedStatement* pvs_dstmt = con.prepare("DELETE FROM pvs WHERE pvname=? AND iocname<>?");
+        pvs_dstmt->setString(2, ioc_name);
+        // a single chunk, so after a deadlock or lock wait timeout all rows are deleted again
+        for(int attempt = 1; ; ++attempt)
+        {
+            try
+            {
+                for(size_t i = 0; i < pvm.size(); ++i)
+                {
+                    pvs_dstmt->setString(1, pvm.name(i));
+                    timedExecuteUpdate(pvs_dstmt, "DELETE pvs");
+                }
+                con.commit();
+                break;
+            }
+            catch (sql::SQLException &e)
+            {
+                if (!retryAfterLockError(con, e, attempt, "cleanup"))
+                {
+                    throw;
+                }
+            }
+        }
+        nchunks = 1;
+    }
+    else if (strategy == CleanupInList)
+    {
+        if (chunk_rows >= MAX_PLACEHOLDERS)
+        {
+            chunk_rows = MAX_PLACEHOLDERS - 1;
+        }
+        sql::PreparedStatement* full_stmt = con.prepare(inListDeleteSQL(chunk_rows));
+        size_t i = 0;
+        while(i < pvm.size())
+        {
+            std::vector<std::string> names;
+            names.reserve(chunk_rows);
+            for(; i < pvm.size() && names.size() < chunk_rows; ++i)
+            {
+                names.push_back(pvm.name(i));
+            }
+            std::auto_ptr< sql::PreparedStatement > part_stmt;
+            sql::PreparedStatement* pstmt = full_stmt;
+            if (names.size() < chunk_rows)
+            {
+                part_stmt.reset(con->prepareStatement(inListDeleteSQL(names.size())));
+                pstmt = part_stmt.get();
+            }
+            for(size_t i = 0; i < names.size(); ++i)
+            {
+                pstmt->setString(static_cast<unsigned>(i + 1), names[i]);
+            }
+            pstmt->setString(static_cast<unsigned>(names.size() + 1), ioc_name);
+            for(int attempt = 1; ; ++attempt)
+            {
+                try
+                {
+                    timedExecuteUpdate(pstmt, "DELETE pvs");
+                    con.commit();
+                    break;
+                }
+                catch (sql::SQLException &e)
+                {
+                    if (!retryAfterLockError(con, e, attempt, "cleanup"))
+                    {
+                        throw;
+                    }
+                }
+            }
+            ++nchunks;
+        }
+    }
+    else
+    {
+	    std::auto_ptr< sql::Statement > stmt(con->createStatement());
+        // temporary tables are private to our session, so no clash with other IOCs doing the same thing
+        timedExecute(stmt.get(), "DROP TEMPORARY TABLE IF EXISTS pvdump_names");
+        timedExecute(stmt.get(), "CREATE TEMPORARY TABLE pvdump_names (chunk INT NOT NULL, PRIMARY KEY (pvname), KEY (chunk)) SELECT 0 AS chunk, pvname FROM pvs LIMIT 0");
+        {
+            BatchInserter names_batch(con, "INSERT INTO pvdump_names (chunk, pvname)", 2, DEFAULT_BATCH_ROWS * 10, DEFAULT_BATCH_BYTES);
+            size_t n = 0;
+            for(; n < pvm.size(); ++n)
+            {
+                std::ostringstream chunk;
+                chunk << n / chunk_rows;
+                const std::string values[2] = { chunk.str(), pvm.name(n) };
+                names_batch.addRow(values);
+            }
+            names_batch.flush();
+            con.commit(); // so rolling back a chunk that hits a deadlock keeps the names
+            nchunks = static_cast<unsigned long>((n + chunk_rows - 1) / chunk_rows);
+        }
+        load_time = elapsedSince(begin_time);
+        sql::PreparedStatement* join_stmt = con.prepare("DELETE pvs FROM pvs INNER JOIN pvdump_names ON pvs.pvname = pvdump_names.pvname WHERE pvdump_names.chunk = ? AND pvs.iocname<>?");
+        join_stmt->setString(2, ioc_name);
+        for(unsigned long i = 0; i < nchunks; ++i)
+        {
+            join_stmt->setInt(1, static_cast<int>(i));
+            for(int attempt = 1; ; ++attempt)
+            {
+                try
+                {
+                    timedExecuteUpdate(join_stmt, "DELETE pvs");
+                    con.commit();
+                    break;
+                }
+                catch (sql::SQLException &e)
+                {
+                    if (!retryAfterLockError(con, e, attempt, "cleanup"))
+                    {
+                        throw;
+                    }
+                }
+            }
+        }
+        timedExecute(stmt.get(), "DROP TEMPORARY TABLE IF EXISTS pvdump_names");
+    }
+    std::cout << "pvdump: cleanup (" << cleanupStrategyName(strategy) << ") of " << pvm.size() << " PVs in " << nchunks << " chunks took " << elapsedSince(begin_time) << " seconds";
+    if (strategy == CleanupTempTable)
+    {
+        std::cout << " (name load " << load_time << " seconds, join delete " << elapsedSince(begin_time) - load_time << " seconds)";
+    }
+    std::cout << std::endl;
+}
+#endif /* PVDUMP_DUMMY */
+
+#ifndef PVDUMP_DUMMY
+/// content fingerprint of each PV, used by incremental sync to work out what changed since the last dump
+typedef std::map<std::string,epicsUInt64> PVFingerprints;
+
+static const epicsUInt64 FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const epicsUInt64 FNV_PRIME = 1099511628211ULL;
+
+// 64 bit FNV-1a hash, a trailing separator is included so ("ab","c") and ("a","bc") differ
+static epicsUInt64 fnv1a(const std::string& str, epicsUInt64 hash)
+{
+    for(size_t i = 0; i < str.size(); ++i)
+    {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= FNV_PRIME;
+    }
+    hash ^= 0xff;
+    hash *= FNV_PRIME;
+    return hash;
+}
+
+// fingerprint of everything we write for a PV i.e. record type, DESC and info fields
+static epicsUInt64 pvFingerprint(const PVCatalog& pvm, size_t i)
+{
+    epicsUInt64 hash = fnv1a(pvm.recordType(i), FNV_OFFSET_BASIS);
+    hash = fnv1a(pvm.recordDesc(i), hash);
+    for(epicsUInt32 k = pvm.firstInfo(i); k != PVCatalog::NO_INFO; k = pvm.nextInfo(k))
+    {
+        hash = fnv1a(pvm.infoName(k), hash);
+        hash = fnv1a(std::string(pvm.infoValue(k)).substr(0, MAX_INFO_VAL_LENGTH), hash);
+    }
+    return hash;
+}
+
+// fill fps with per PV fingerprints and return a fingerprint for the IOC as a whole
+static epicsUInt64 computeFingerprints(const PVCatalog& pvm, PVFingerprints& fps)
+{
+    epicsUInt64 ioc_hash = FNV_OFFSET_BASIS;
+    char buffer[32];
+    fps.clear();
+    for(size_t i = 0; i < pvm.size(); ++i)
+    {
+        epicsUInt64 hash = pvFingerprint(pvm, i);
+        fps.insert(fps.end(), std::make_pair(std::string(pvm.name(i)), hash));
+        sprintf(buffer, "%016llx", static_cast<unsigned long long>(hash));
+        ioc_hash = fnv1a(buffer, fnv1a(pvm.name(i), ioc_hash));
+    }
+    return ioc_hash;
+}
+
+// snapshots are per IOC and per database server, so pointing an IOC at a different server forces a full write
+// return dir_env_name from the environment or else the system temporary directory, plus a file name
+// made safe for use on any file system. Forward slashes are used so the path can also be given to MySQL.
+static std::string localFileName(const char* dir_env_name, const std::string& file_name)
+{
+    std::string dir = getEnvString(dir_env_name, "");
+    if (dir.empty())
+    {
+        dir = getEnvString("TEMP", getEnvString("TMPDIR", "/tmp").c_str());
+    }
+    std::string name(file_name);
+    for(size_t i = 0; i < name.size(); ++i)
+    {
+        if (strchr("\\/:*?\"<>| ", name[i]) != NULL)
+        {
+            name[i] = '_';
+        }
+    }
+    std::string path = dir + "/" + name;
+    for(size_t i = 0; i < path.size(); ++i)
+    {
+        if (path[i] == '\\')
+        {
+            path[i] = '/';
+        }
+    }
+    return path;
+}
+
+static std::string snapshotFileName(const std::string& mysql_host)
+{
+    return localFileName("PVDUMP_SNAPSHOT_DIR", "pvdump_" + ioc_name + "_" + mysql_host + ".snap");
+}
+
+static const char* SNAPSHOT_HEADER = "pvdump-snapshot-1";
+
+// load fingerprints saved by the last successful dump, returns false if there is no usable snapshot
+static bool loadSnapshot(const std::string& file_name, PVFingerprints& fps, epicsUInt64& ioc_hash)
+{
+    std::ifstream fs(file_name.c_str());
+    std::string header, pvname;
+    unsigned long long hash;
+    size_t npv = 0;
+    fps.clear();
+    if ( !(fs >> header >> std::hex >> hash >> std::dec >> npv) || header != SNAPSHOT_HEADER )
+    {
+        return false;
+    }
+    ioc_hash = hash;
+    while(fs >> std::hex >> hash >> pvname)
+    {
+        fps.insert(fps.end(), std::make_pair(pvname, static_cast<epicsUInt64>(hash)));
+    }
+    if (fps.size() != npv)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: ignoring truncated snapshot file \"%s\"\n", file_name.c_str());
+        fps.clear();
+        return false;
+    }
+    return true;
+}
+
+// written via a temporary file and rename so a crash never leaves a partial snapshot
+static bool saveSnapshot(const std::string& file_name, const PVFingerprints& fps, epicsUInt64 ioc_hash)
+{
+    std::string tmp_name = file_name + ".tmp";
+    {
+        std::ofstream fs(tmp_name.c_str(), std::ios::out | std::ios::trunc);
+        fs << SNAPSHOT_HEADER << " " << std::hex << ioc_hash << std::dec << " " << fps.size() << "\n";
+        for(PVFingerprints::const_iterator it = fps.begin(); it != fps.end(); ++it)
+        {
+            fs << std::hex << it->second << " " << it->first << "\n";
+        }
+        if (!fs.good())
+        {
+            errlogSevPrintf(errlogMinor, "pvdump: cannot write snapshot file \"%s\"\n", tmp_name.c_str());
+            return false;
+        }
+    }
+    remove(file_name.c_str());
+    if (rename(tmp_name.c_str(), file_name.c_str()) != 0)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: cannot rename snapshot file to \"%s\"\n", file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+// PVDUMP_WRITE=upsert updates our existing rows in place rather than deleting them all and inserting again
+static bool upsertEnabled()
+{
+    std::string mode = getEnvString("PVDUMP_WRITE", "replace");
+    if (mode != "replace" && mode != "upsert")
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: unknown PVDUMP_WRITE mode \"%s\" (expected replace or upsert), using replace\n", mode.c_str());
+    }
+    return (mode == "upsert");
+}
+
+static bool incrementalSyncEnabled()
+{
+    std::string mode = getEnvString("PVDUMP_SYNC", "full");
+    if (mode != "full" && mode != "incremental")
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: unknown PVDUMP_SYNC mode \"%s\" (expected full or incremental), using full\n", mode.c_str());
+    }
+    return (mode == "incremental");
+}
+
+// PVDUMP_SCAN=stream has the writer thread scan the IOC in chunks, writing each while the next is scanned, rather
+// than pvdump() building a catalog of the whole IOC first. Incremental sync, upsert and the spool all need the
+// whole catalog so are not used.
+static bool streamScanEnabled()
+{
+    std::string mode = getEnvString("PVDUMP_SCAN", "catalog");
+    if (mode != "catalog" && mode != "stream")
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: unknown PVDUMP_SCAN mode \"%s\" (expected catalog or stream), using catalog\n", mode.c_str());
+    }
+    return (mode == "stream");
+}
+
+static bool bulkLoadEnabled()
+{
+    std::string mode = (load_mode.empty() ? getEnvString("PVDUMP_LOAD", "insert") : load_mode);
+    if (mode != "insert" && mode != "bulk")
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: unknown load mode \"%s\" (expected insert or bulk), using insert\n", mode.c_str());
+    }
+    return (mode == "bulk");
+}
+
+/// Writes rows as a tab separated file in the default format expected by LOAD DATA INFILE,
+/// i.e. fields terminated by tab, lines by newline and special characters escaped with backslash.
+class TsvWriter
+{
+    std::string m_file_name;
+    FILE* m_fp;
+    unsigned long m_nrows;
+    long m_nbytes;
+    
+    void writeField(const std::string& value)
+    {
+        for(size_t i = 0; i < value.size(); ++i)
+        {
+            switch(value[i])
+            {
+                case '\\':
+                    fputs("\\\\", m_fp);
+                    break;
+                case '\t':
+                    fputs("\\t", m_fp);
+                    break;
+                case '\n':
+                    fputs("\\n", m_fp);
+                    break;
+                case '\r':
+                    fputs("\\r", m_fp);
+                    break;
+                case '\0':
+                    fputs("\\0", m_fp);
+                    break;
+                default:
+                    fputc(value[i], m_fp);
+                    break;
+            }
+        }
+    }
+    
+public:
+    explicit TsvWriter(const std::string& file_name) : m_file_name(file_name), m_nrows(0), m_nbytes(0)
+    {
+        m_fp = fopen(file_name.c_str(), "wb");
+        if (m_fp == NULL)
+        {
+            throw std::runtime_error("cannot create bulk load file \"" + file_name + "\": " + strerror(errno));
+        }
+    }
+    
+    ~TsvWriter()
+    {
+        if (m_fp != NULL)
+        {
+            fclose(m_fp);
+        }
+        remove(m_file_name.c_str());
+    }
+    
+    void addRow(const std::string* values, int ncols)
+    {
+        for(int i = 0; i < ncols; ++i)
+        {
+            if (i > 0)
+            {
+                fputc('\t', m_fp);
+            }
+            writeField(values[i]);
+        }
+        fputc('\n', m_fp);
+        ++m_nrows;
+    }
+    
+    /// close the file ready for loading
+    void close()
+    {
+        if (m_fp != NULL)
+        {
+            m_nbytes = ftell(m_fp);
+        }
+        if (m_fp != NULL && fclose(m_fp) != 0)
+        {
+            m_fp = NULL;
+            throw std::runtime_error("error writing bulk load file \"" + m_file_name + "\"");
+        }
+        m_fp = NULL;
+    }
+    
+    /// the LOAD DATA statement for this file, the file name is quoted for use in SQL
+    std::string loadStatement(const std::string& table_and_columns) const
+    {
+        std::string quoted;
+        for(size_t i = 0; i < m_file_name.size(); ++i)
+        {
+            if (m_file_name[i] == '\'' || m_file_name[i] == '\\')
+            {
+                quoted += '\\';
+            }
+            quoted += m_file_name[i];
+        }
+        return "LOAD DATA LOCAL INFILE '" + quoted + "' INTO TABLE " + table_and_columns;
+    }
+    
+    unsigned long rows() const { return m_nrows; }
+    /// size of the file once closed
+    long bytes() const { return m_nbytes; }
+};
+
+// LOAD DATA LOCAL skips a row that hits a duplicate key or foreign key error with just a warning, so check
+// the statement last executed on stmt loaded every row of file
+static bool allRowsLoaded(sql::Statement* stmt, const TsvWriter& file)
+{
+    std::auto_ptr< sql::ResultSet > res(timedExecuteQuery(stmt, "SELECT ROW_COUNT()"));
+    return (res->next() && res->getUInt64(1) == file.rows());
+}
+
+// load PVs and their info fields with LOAD DATA LOCAL INFILE, existing rows with the same names must have
+// been removed first. Returns false, with nothing written, if the server or client does not allow local infile
+// or not every row was loaded, so that INSERT can be used and report what is wrong.
+static bool bulkLoadPVs(PvdumpConnection& con, const PVCatalog& pvm, unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("bulk load");
+    const epicsTime begin_time = epicsTime::getCurrent();
+    std::ostringstream prefix;
+    prefix << "pvdump_" << ioc_name << "_" << get_pid();
+    TsvWriter pvs_file(localFileName("PVDUMP_BULK_DIR", prefix.str() + "_pvs.tsv"));
+    TsvWriter pvinfo_file(localFileName("PVDUMP_BULK_DIR", prefix.str() + "_pvinfo.tsv"));
+    for(size_t i = 0; i < pvm.size(); ++i)
+    {
+        const std::string pvs_values[4] = { pvm.name(i), pvm.recordType(i), pvm.recordDesc(i), ioc_name };
+        pvs_file.addRow(pvs_values, 4);
+        for(epicsUInt32 k = pvm.firstInfo(i); k != PVCatalog::NO_INFO; k = pvm.nextInfo(k))
+		{
+            const std::string pvinfo_values[3] = { pvm.name(i), pvm.infoName(k), std::string(pvm.infoValue(k)).substr(0, MAX_INFO_VAL_LENGTH) };
+            pvinfo_file.addRow(pvinfo_values, 3);
+		}
+    }
+    pvs_file.close();
+    pvinfo_file.close();
+    std::auto_ptr< sql::Statement > stmt(con->createStatement());
+    const char* skipped = NULL;
+    try
+    {
+        timedExecute(stmt.get(), pvs_file.loadStatement("pvs (pvname, record_type, record_desc, iocname)"));
+        if (!allRowsLoaded(stmt.get(), pvs_file))
+        {
+            skipped = "pvs";
+        }
+        else
+        {
+            timedExecute(stmt.get(), pvinfo_file.loadStatement("pvinfo (pvname, infoname, value)"));
+            skipped = (allRowsLoaded(stmt.get(), pvinfo_file) ? NULL : "pvinfo");
+        }
+    }
+    catch(sql::SQLException& e)
+    {
+        con->rollback();
+        errlogSevPrintf(errlogMinor, "pvdump: bulk load not possible, using INSERT instead: %s (MySQL error code: %d)\n", e.what(), e.getErrorCode());
+        return false;
+    }
+    if (skipped != NULL)
+    {
+        con->rollback();
+        errlogSevPrintf(errlogMinor, "pvdump: bulk load of %s skipped rows, using INSERT instead\n", skipped);
+        return false;
+    }
+    con.commit();
+    PvdumpStatus::instance().addBytes(pvs_file.bytes() + pvinfo_file.bytes());
+    npv += pvs_file.rows();
+    ninfo += pvinfo_file.rows();
+    nstatements += 4;
+    double elapsed = elapsedSince(begin_time);
+    std::cout << "pvdump: bulk loaded " << pvs_file.rows() + pvinfo_file.rows() << " pvs/pvinfo rows in " << elapsed << " seconds";
+    if (elapsed > 0.0)
+    {
+        std::cout << " (" << static_cast<unsigned long>((pvs_file.rows() + pvinfo_file.rows()) / elapsed) << " rows/sec)";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+// the name=value environment strings we record for an IOC, long values like PATH are ignored
+static void getIocEnvRows(const std::list<std::string>& evl, std::vector< std::pair<std::string,std::string> >& rows)
+{
+    for(std::list<std::string>::const_iterator it = evl.begin(); it != evl.end(); ++it)
+    {
+        const std::string& s = *it;
+		size_t pos = s.find('=');
+        if (pos != std::string::npos)
+        {
+			if ( (s.size() - pos) < MAX_MACRO_VAL_LENGTH )  // ignore things with long values like PATH
+			{
+                rows.push_back(std::make_pair(s.substr(0, pos), s.substr(pos + 1))); // name, value
+			}
+		}
+	}
+}
+
+// write iocenv rows for our IOC, previous rows have already been deleted by dumpMysql(). Returns number of macros written.
+static unsigned long writeIocEnv(PvdumpConnection& con, const std::list<std::string>& evl, bool bulk, size_t batch_rows, size_t batch_bytes, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("iocenv");
+    std::vector< std::pair<std::string,std::string> > rows;
+    getIocEnvRows(evl, rows);
+    if (bulk)
+    {
+        std::ostringstream file_name;
+        file_name << "pvdump_" << ioc_name << "_" << get_pid() << "_iocenv.tsv";
+        TsvWriter iocenv_file(localFileName("PVDUMP_BULK_DIR", file_name.str()));
+        for(size_t i = 0; i < rows.size(); ++i)
+        {
+            const std::string values[3] = { ioc_name, rows[i].first, rows[i].second };
+            iocenv_file.addRow(values, 3);
+        }
+        iocenv_file.close();
+        try
+        {
+            std::auto_ptr< sql::Statement > stmt(con->createStatement());
+            timedExecute(stmt.get(), iocenv_file.loadStatement("iocenv (iocname, macroname, macroval)"));
+            nstatements += 2;
+            if (allRowsLoaded(stmt.get(), iocenv_file))
+            {
+                con.commit();
+                PvdumpStatus::instance().addBytes(iocenv_file.bytes());
+                return static_cast<unsigned long>(rows.size());
+            }
+            con->rollback();
+            errlogSevPrintf(errlogMinor, "pvdump: bulk load of iocenv skipped rows, using INSERT instead\n");
+        }
+        catch(sql::SQLException& e)
+        {
+            con->rollback();
+            errlogSevPrintf(errlogMinor, "pvdump: bulk load of iocenv not possible, using INSERT instead: %s (MySQL error code: %d)\n", e.what(), e.getErrorCode());
+        }
+    }
+	BatchInserter iocenv_batch(con, "INSERT INTO iocenv (iocname, macroname, macroval)", 3, batch_rows, batch_bytes);
+    for(size_t i = 0; i < rows.size(); ++i)
+    {
+        iocenv_batch.addRow(ioc_name, rows[i].first, rows[i].second);
+    }
+    iocenv_batch.flush();
+	con.commit();
+    nstatements += iocenv_batch.statements();
+    return static_cast<unsigned long>(rows.size());
+}
+#endif /* PVDUMP_DUMMY */
+
+/// a request to the writer thread, it holds a reference to an immutable catalog and its own copy of the
+/// environment so later pvdump calls can rescan while it is being written
+struct MysqlThreadArgs
+{
+    PVCatalogRef pvm;
+    std::list<std::string> evl;
+    std::string mysql_host;
+    int pid;
+    std::string exe_path;
+    unsigned long seq; ///< run_info sequence number, 0 if not the current pvdump
+    bool incremental; ///< write snapshot file after a successful dump
+    bool upsert; ///< our rows from last time have not been deleted, update them in place
+    bool bulk; ///< use LOAD DATA LOCAL INFILE rather than INSERT where possible
+    bool stream; ///< pvm is not used, the writer scans the IOC itself a chunk at a time
+#ifndef PVDUMP_DUMMY
+    bool have_snapshot; ///< old_fps describes what is currently in the database for this IOC
+    PVFingerprints old_fps;
+    epicsUInt64 old_ioc_hash;
+#endif /* PVDUMP_DUMMY */
+    MysqlThreadArgs(const PVCatalogRef& pvm_,
+                    const std::list<std::string>& evl_,
+                    const std::string& mysql_host_) : pvm(pvm_), evl(evl_), mysql_host(mysql_host_), pid(0), seq(0), incremental(false), upsert(false), bulk(false), stream(false)
+#ifndef PVDUMP_DUMMY
+                    , have_snapshot(false), old_ioc_hash(0)
+#endif /* PVDUMP_DUMMY */
+                    { }
+};
+
+#ifndef PVDUMP_DUMMY
+// insert PVs [begin, end) of pvm and their info fields, leaving the caller to commit
+static void insertChunk(PvdumpConnection& con, const PVCatalog& pvm, size_t begin, size_t end, bool upsert, size_t batch_rows, size_t batch_bytes,
+                        unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements, double& pvs_time, double& pvinfo_time)
+{
+    const epicsTime pvs_start = epicsTime::getCurrent();
+    // pvs rows must all be sent before pvinfo rows that reference them via the foreign key
+	BatchInserter pvs_batch(con, "INSERT INTO pvs (pvname, record_type, record_desc, iocname)", 4, batch_rows, batch_bytes,
+        (upsert ? " ON DUPLICATE KEY UPDATE record_type=VALUES(record_type), record_desc=VALUES(record_desc), iocname=VALUES(iocname)" : ""));
+    for(size_t i = begin; i < end; ++i)
+    {
+		++npv;
+        pvs_batch.addRow(pvm.name(i), pvm.recordType(i), pvm.recordDesc(i), ioc_name);
+    }
+    pvs_batch.flush();
+    pvs_time += elapsedSince(pvs_start);
+    const epicsTime pvinfo_start = epicsTime::getCurrent();
+	BatchInserter pvinfo_batch(con, "INSERT INTO pvinfo (pvname, infoname, value)", 3, batch_rows, batch_bytes,
+        (upsert ? " ON DUPLICATE KEY UPDATE value=VALUES(value)" : ""));
+    for(size_t i = begin; i < end; ++i)
+    {
+        for(epicsUInt32 k = pvm.firstInfo(i); k != PVCatalog::NO_INFO; k = pvm.nextInfo(k))
+		{
+			++ninfo;
+			pvinfo_batch.addRow(pvm.name(i), pvm.infoName(k), std::string(pvm.infoValue(k)).substr(0, MAX_INFO_VAL_LENGTH));
+		}
+    }
+    pvinfo_batch.flush();
+    pvinfo_time += elapsedSince(pvinfo_start);
+    nstatements += pvs_batch.statements() + pvinfo_batch.statements();
+}
+
+// insert PVs and their info fields. Unless upsert is set, any existing rows with the same names must have been removed first.
+// Each PVDUMP_COMMIT_ROWS PVs are a transaction of their own, retried alone if they hit a deadlock or lock wait timeout.
+// If committed is given the first *committed PVs of pvm are skipped, and it is updated as each chunk is committed, so
+// after a failure the caller can carry on from where it got to.
+static void insertPVs(PvdumpConnection& con, const PVCatalog& pvm, bool upsert, size_t batch_rows, size_t batch_bytes, unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements,
+                      size_t* committed = NULL)
+{
+    const size_t commit_rows = std::max(1, getEnvInt("PVDUMP_COMMIT_ROWS", DEFAULT_COMMIT_ROWS));
+    double pvs_time = 0.0, pvinfo_time = 0.0;
+    for(size_t begin = (committed != NULL ? *committed : 0), end = 0; begin < pvm.size(); begin = end)
+    {
+        end = std::min(begin + commit_rows, pvm.size());
+        for(int attempt = 1; ; ++attempt)
+        {
+            unsigned long chunk_npv = 0, chunk_ninfo = 0, chunk_statements = 0;
+            try
+            {
+                insertChunk(con, pvm, begin, end, upsert, batch_rows, batch_bytes, chunk_npv, chunk_ninfo, chunk_statements, pvs_time, pvinfo_time);
+	            con.commit();
+            }
+            catch (sql::SQLException &e)
+            {
+                if (!retryAfterLockError(con, e, attempt, "insert"))
+                {
+                    throw;
+                }
+                continue;
+            }
+            npv += chunk_npv;
+            ninfo += chunk_ninfo;
+            nstatements += chunk_statements;
+            if (committed != NULL)
+            {
+                *committed = end;
+            }
+            break;
+        }
+    }
+    PvdumpStats::instance().addPhase("insert pvs", pvs_time);
+    PvdumpStats::instance().addPhase("insert pvinfo", pvinfo_time);
+}
+
+/// One of PVDUMP_SHARDS contiguous name ranges of a catalog, written on its own thread, connection and
+/// transaction. Shards never share a PV so their deletes and inserts do not contend for the same rows.
+struct ShardWriter
+{
+    int index;
+    const PVCatalog* pvm;
+    size_t begin; ///< PVs [begin, end) of pvm
+    size_t end;
+    std::string mysql_host;
+    bool upsert;
+    size_t batch_rows;
+    size_t batch_bytes;
+    CleanupStrategy strategy;
+    size_t cleanup_chunk;
+    int max_attempts;
+    unsigned long npv;
+    unsigned long ninfo;
+    unsigned long nstatements;
+    int attempts;
+    double write_time;
+    std::string error; ///< why the last attempt failed, empty if the shard was written
+    epicsEvent done;
+    ShardWriter() : index(0), pvm(NULL), begin(0), end(0), upsert(false), batch_rows(0), batch_bytes(0), strategy(CleanupPerRow),
+                    cleanup_chunk(0), max_attempts(1), npv(0), ninfo(0), nstatements(0), attempts(0), write_time(0.0) { }
+};
+
+static void shardWriterThread(void* arg)
+{
+    ShardWriter* shard = static_cast<ShardWriter*>(arg);
+    const epicsTime start = epicsTime::getCurrent();
+    try
+    {
+        PVCatalog pvs;
+        for(size_t i = shard->begin; i < shard->end; ++i)
+        {
+            pvs.addFrom(*shard->pvm, i);
+        }
+        pvs.finalize();
+        // counts are of committed rows, so carry over from one attempt to the next
+        unsigned long npv = 0, ninfo = 0, nstatements = 0;
+        size_t committed = 0;
+        while(shard->attempts < shard->max_attempts)
+        {
+            ++shard->attempts;
+            try
+            {
+                // insertPVs() commits every PVDUMP_COMMIT_ROWS PVs, a chunk that was not committed is rolled back when
+                // the connection goes back to the pool, so a retry carries on after the last chunk committed
+                PooledConnection con(shard->mysql_host);
+                if (committed == 0)
+                {
+                    deleteDuplicatePVs(*con, pvs, shard->strategy, shard->cleanup_chunk);
+                }
+                insertPVs(*con, pvs, shard->upsert, shard->batch_rows, shard->batch_bytes, npv, ninfo, nstatements, &committed);
+                shard->npv = npv;
+                shard->ninfo = ninfo;
+                shard->nstatements = nstatements;
+                shard->error.clear();
+                break;
+            }
+            catch (sql::SQLException &e)
+            {
+                std::ostringstream msg;
+                msg << e.what() << " (MySQL error code: " << e.getErrorCode() << ", SQLState: " << e.getSQLStateCStr() << ")";
+                shard->error = msg.str();
+            }
+            catch (std::exception &e)
+            {
+                shard->error = e.what();
+            }
+            errlogSevPrintf(errlogMinor, "pvdump: shard %d attempt %d of %d failed: %s\n", shard->index, shard->attempts, shard->max_attempts, shard->error.c_str());
+            if (shard->attempts < shard->max_attempts)
+            {
+                PvdumpStatus::instance().addRetry();
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        shard->error = e.what();
+    }
+    shard->write_time = elapsedSince(start);
+    shard->done.signal();
+}
+
+// number of shards to split npv PVs into, each gets at least a batch so small IOCs are not split
+static int shardCount(size_t npv, size_t batch_rows)
+{
+    const size_t nshards = getEnvInt("PVDUMP_SHARDS", 1);
+    const size_t max_shards = std::max(static_cast<size_t>(1), npv / std::max(batch_rows, static_cast<size_t>(1)));
+    return static_cast<int>(std::max(static_cast<size_t>(1), std::min(nshards, max_shards)));
+}
+
+// remove duplicates of and insert the PVs of pvm, split into nshards name ranges written in parallel
+static void writeShards(const PVCatalog& pvm, const MysqlThreadArgs& marg, int nshards, size_t batch_rows, size_t batch_bytes,
+                        unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("sharded write");
+    std::vector<ShardWriter*> shards;
+    for(int j = 0; j < nshards; ++j)
+    {
+        ShardWriter* shard = new ShardWriter;
+        shard->index = j;
+        shard->pvm = &pvm;
+        shard->begin = pvm.size() * j / nshards;
+        shard->end = pvm.size() * (j + 1) / nshards;
+        shard->mysql_host = marg.mysql_host;
+        shard->upsert = marg.upsert;
+        shard->batch_rows = batch_rows;
+        shard->batch_bytes = batch_bytes;
+        shard->strategy = getCleanupStrategy();
+        shard->cleanup_chunk = getEnvInt("PVDUMP_CLEANUP_CHUNK", static_cast<int>(batch_rows));
+        shard->max_attempts = std::max(1, getEnvInt("PVDUMP_SHARD_ATTEMPTS", DEFAULT_SHARD_ATTEMPTS));
+        shards.push_back(shard);
+    }
+    for(int j = 0; j < nshards; ++j)
+    {
+        if (epicsThreadCreate("pvdumpShard", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                              shardWriterThread, shards[j]) == 0)
+        {
+            shardWriterThread(shards[j]); // do it ourselves
+        }
+    }
+    int nfailed = 0;
+    for(int j = 0; j < nshards; ++j)
+    {
+        ShardWriter* shard = shards[j];
+        shard->done.wait();
+        std::cout << "pvdump: shard " << j << " \"" << (shard->begin < shard->end ? pvm.name(shard->begin) : "") << "\" to \"" <<
+            (shard->begin < shard->end ? pvm.name(shard->end - 1) : "") << "\": " << shard->npv << " PVs, " << shard->ninfo << " info entries, " <<
+            shard->nstatements << " statements in " << shard->write_time << " seconds";
+        if (shard->attempts > 1)
+        {
+            std::cout << " (" << shard->attempts << " attempts)";
+        }
+        if (!shard->error.empty())
+        {
+            std::cout << " FAILED: " << shard->error;
+            ++nfailed;
+        }
+        std::cout << std::endl;
+        npv += shard->npv;
+        ninfo += shard->ninfo;
+        nstatements += shard->nstatements;
+        delete shard;
+    }
+    std::cout << "pvdump: " << nshards << " shards wrote " << npv << " PVs and " << ninfo << " info entries in " << timer.elapsed() << " seconds" << std::endl;
+    if (nfailed > 0)
+    {
+        std::ostringstream msg;
+        msg << nfailed << " of " << nshards << " shards could not be written";
+        throw std::runtime_error(msg.str());
+    }
+}
+
+// for upsert mode: delete rows from a previous dump of this IOC that are no longer in pvm, i.e. PVs and info
+// fields that have really gone. Deletes are done in primary key order.
+static void deleteVanishedRows(PvdumpConnection& con, const PVCatalog& pvm, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("delete vanished");
+    std::vector<std::string> vanished_pvs;
+    std::vector< std::pair<std::string,std::string> > vanished_info;
+    {
+        sql::PreparedStatement* query_stmt = con.prepare("SELECT pvname FROM pvs WHERE iocname=? ORDER BY pvname");
+        query_stmt->setString(1, ioc_name);
+        std::auto_ptr< sql::ResultSet > res(timedExecuteQuery(query_stmt, "SELECT pvs"));
+        while(res->next())
+        {
+            std::string pvname = res->getString(1);
+            if (pvm.find(pvname.c_str()) == PVCatalog::npos)
+            {
+                vanished_pvs.push_back(pvname);
+            }
+        }
+    }
+    {
+        sql::PreparedStatement* query_stmt = con.prepare("SELECT pvinfo.pvname, pvinfo.infoname FROM pvinfo INNER JOIN pvs ON pvs.pvname = pvinfo.pvname WHERE pvs.iocname=? ORDER BY pvinfo.pvname, pvinfo.infoname");
+        query_stmt->setString(1, ioc_name);
+        std::auto_ptr< sql::ResultSet > res(timedExecuteQuery(query_stmt, "SELECT pvinfo"));
+        while(res->next())
+        {
+            std::string pvname = res->getString(1);
+            size_t i = pvm.find(pvname.c_str());
+            if (i != PVCatalog::npos) // info for a vanished PV is removed by the foreign key cascade
+            {
+                std::string infoname = res->getString(2);
+                if (pvm.findInfo(i, infoname.c_str()) == NULL)
+                {
+                    vanished_info.push_back(std::make_pair(pvname, infoname));
+                }
+            }
+        }
+    }
+    if (!vanished_pvs.empty())
+    {
+        sql::PreparedStatement* pvs_dstmt = con.prepare("DELETE FROM pvs WHERE pvname=? AND iocname=?");
+        pvs_dstmt->setString(2, ioc_name);
+        for(size_t i = 0; i < vanished_pvs.size(); ++i)
+        {
+            pvs_dstmt->setString(1, vanished_pvs[i]);
+            timedExecuteUpdate(pvs_dstmt, "DELETE pvs");
+            ++nstatements;
+        }
+    }
+    if (!vanished_info.empty())
+    {
+        sql::PreparedStatement* pvinfo_dstmt = con.prepare("DELETE FROM pvinfo WHERE pvname=? AND infoname=?");
+        for(size_t i = 0; i < vanished_info.size(); ++i)
+        {
+            pvinfo_dstmt->setString(1, vanished_info[i].first);
+            pvinfo_dstmt->setString(2, vanished_info[i].second);
+            timedExecuteUpdate(pvinfo_dstmt, "DELETE pvinfo");
+            ++nstatements;
+        }
+    }
+    con.commit();
+    std::cout << "pvdump: upsert removed " << vanished_pvs.size() << " vanished PVs and " << vanished_info.size() << " vanished info entries" << std::endl;
+}
+
+// apply only the differences between the last snapshot and the current PVs
+static void syncChangedPVs(PvdumpConnection& con, const PVCatalog& pvm, const PVFingerprints& old_fps, const PVFingerprints& new_fps, bool upsert,
+                           size_t batch_rows, size_t batch_bytes, unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("incremental sync");
+    PVCatalog added;
+    PVCatalog changed;
+    std::vector<std::string> removed;
+    // both maps are sorted by name, so walk them together
+    PVFingerprints::const_iterator it_old = old_fps.begin(), it_new = new_fps.begin();
+    while(it_old != old_fps.end() || it_new != new_fps.end())
+    {
+        if (it_new == new_fps.end() || (it_old != old_fps.end() && it_old->first < it_new->first))
+        {
+            removed.push_back(it_old->first);
+            ++it_old;
+        }
+        else if (it_old == old_fps.end() || it_new->first < it_old->first)
+        {
+            added.addFrom(pvm, pvm.find(it_new->first.c_str()));
+            ++it_new;
+        }
+        else
+        {
+            if (it_old->second != it_new->second)
+            {
+                changed.addFrom(pvm, pvm.find(it_new->first.c_str()));
+            }
+            ++it_old;
+            ++it_new;
+        }
+    }
+    added.finalize();
+    changed.finalize();
+    std::cout << "pvdump: incremental sync: " << added.size() << " added, " << changed.size() << " changed, " << removed.size() << " removed PVs" << std::endl;
+    if (!removed.empty())
+    {
+        // only remove rows that are still ours, another IOC may since have registered the same name
+        sql::PreparedStatement* remove_stmt = con.prepare("DELETE FROM pvs WHERE pvname=? AND iocname=?");
+        remove_stmt->setString(2, ioc_name);
+        for(size_t i = 0; i < removed.size(); ++i)
+        {
+            remove_stmt->setString(1, removed[i]);
+            timedExecuteUpdate(remove_stmt, "DELETE pvs");
+            ++nstatements;
+        }
+        con.commit();
+    }
+    if (!changed.empty())
+    {
+        sql::PreparedStatement* update_stmt = con.prepare("UPDATE pvs SET record_type=?, record_desc=?, iocname=? WHERE pvname=?");
+        sql::PreparedStatement* info_dstmt = con.prepare("DELETE FROM pvinfo WHERE pvname=?");
+        BatchInserter pvinfo_batch(con, "INSERT INTO pvinfo (pvname, infoname, value)", 3, batch_rows, batch_bytes);
+        for(size_t i = 0; i < changed.size(); ++i)
+        {
+            ++npv;
+            update_stmt->setString(1, changed.recordType(i));
+            update_stmt->setString(2, changed.recordDesc(i));
+            update_stmt->setString(3, ioc_name);
+            update_stmt->setString(4, changed.name(i));
+            timedExecuteUpdate(update_stmt, "UPDATE pvs");
+            info_dstmt->setString(1, changed.name(i));
+            timedExecuteUpdate(info_dstmt, "DELETE pvinfo");
+            nstatements += 2;
+        }
+        for(size_t i = 0; i < changed.size(); ++i)
+        {
+            for(epicsUInt32 k = changed.firstInfo(i); k != PVCatalog::NO_INFO; k = changed.nextInfo(k))
+		    {
+			    ++ninfo;
+			    pvinfo_batch.addRow(changed.name(i), changed.infoName(k), std::string(changed.infoValue(k)).substr(0, MAX_INFO_VAL_LENGTH));
+		    }
+        }
+        pvinfo_batch.flush();
+        con.commit();
+        nstatements += pvinfo_batch.statements();
+    }
+    if (!added.empty())
+    {
+        deleteDuplicatePVs(con, added, getCleanupStrategy(), getEnvInt("PVDUMP_CLEANUP_CHUNK", static_cast<int>(batch_rows)));
+        insertPVs(con, added, upsert, batch_rows, batch_bytes, npv, ninfo, nstatements);
+    }
+}
+
+// scan the IOC on another thread and write each chunk as it arrives, our old rows must have been removed first
+static void streamPVs(PvdumpConnection& con, MysqlThreadArgs& marg, size_t batch_rows, size_t batch_bytes, unsigned long& npv, unsigned long& ninfo, unsigned long& nstatements)
+{
+    PvdumpPhaseTimer timer("stream");
+    StreamScan scan(getEnvInt("PVDUMP_STREAM_QUEUE", DEFAULT_STREAM_QUEUE), getEnvInt("PVDUMP_STREAM_CHUNK", DEFAULT_STREAM_CHUNK));
+    if (epicsThreadCreate("pvdumpStream", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                          streamScanThread, &scan) == 0)
+    {
+        throw std::runtime_error("cannot create stream scan thread");
+    }
+    const CleanupStrategy strategy = getCleanupStrategy();
+    const size_t cleanup_chunk = getEnvInt("PVDUMP_CLEANUP_CHUNK", static_cast<int>(batch_rows));
+    bool bulk = marg.bulk;
+    unsigned long nchunks = 0;
+    {
+        StreamScanGuard guard(scan);
+        PVCatalog* next;
+        while((next = scan.queue.pop()) != NULL)
+        {
+            std::auto_ptr<PVCatalog> chunk(next);
+            deleteDuplicatePVs(con, *chunk, strategy, cleanup_chunk);
+            if ( !(bulk && bulkLoadPVs(con, *chunk, npv, ninfo, nstatements)) )
+            {
+                bulk = false; // no point trying again for the next chunk
+                insertPVs(con, *chunk, false, batch_rows, batch_bytes, npv, ninfo, nstatements);
+            }
+            ++nchunks;
+        }
+    }
+    if (!scan.error.empty())
+    {
+        throw std::runtime_error("stream scan failed: " + scan.error);
+    }
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        if (marg.seq == run_seq)
+        {
+            run_info.npv = scan.npv;
+            run_info.ninfo = scan.ninfo;
+            run_info.scan_time = scan.scan_time;
+        }
+    }
+    std::cout << "pvdump: streamed " << scan.npv << " PVs in " << nchunks << " chunks, scan took " << scan.scan_time <<
+        " seconds, scan and write " << timer.elapsed() << " seconds" << std::endl;
+}
+#endif /* PVDUMP_DUMMY */
+
+#ifndef PVDUMP_DUMMY
+// write the PVs, info fields and environment of marg to MySQL, setupMysql() must have been called first
+static void writeMysql(MysqlThreadArgs& marg)
+{
+    unsigned long npv = 0, ninfo = 0, nmacro = 0;
+    PvdumpPhaseTimer timer("write");
+    PooledConnection con(marg.mysql_host.c_str());
+    const size_t batch_rows = getSetting(pvdumpBatchRows, "PVDUMP_BATCH_ROWS", DEFAULT_BATCH_ROWS);
+    const size_t batch_bytes = getSetting(pvdumpBatchBytes, "PVDUMP_BATCH_BYTES", DEFAULT_BATCH_BYTES);
+    unsigned long nstatements = 0;
+    PVFingerprints new_fps;
+    epicsUInt64 new_ioc_hash = 0;
+    if (marg.incremental)
+    {
+        new_ioc_hash = computeFingerprints(*marg.pvm, new_fps);
+    }
+    const epicsTime insert_time = epicsTime::getCurrent();
+    double delete_time = 0.0;
+    if (marg.have_snapshot && new_ioc_hash == marg.old_ioc_hash)
+    {
+        std::cout << "pvdump: IOC fingerprint unchanged since last dump, skipping pvs/pvinfo update" << std::endl;
+    }
+    else if (marg.stream)
+    {
+        streamPVs(*con, marg, batch_rows, batch_bytes, npv, ninfo, nstatements);
+    }
+    else if (marg.have_snapshot)
+    {
+        syncChangedPVs(*con, *marg.pvm, marg.old_fps, new_fps, marg.upsert, batch_rows, batch_bytes, npv, ninfo, nstatements);
+    }
+    else
+    {
+        if (marg.upsert)
+        {
+            deleteVanishedRows(*con, *marg.pvm, nstatements);
+        }
+        const int nshards = shardCount(marg.pvm->size(), batch_rows);
+        // a single LOAD DATA is already the quickest way to send the rows, so bulk loads are not sharded
+        if (nshards > 1 && !(marg.bulk && !marg.upsert))
+        {
+            // each shard does its own cleanup, so delete_time is included in the insert time
+            writeShards(*marg.pvm, marg, nshards, batch_rows, batch_bytes, npv, ninfo, nstatements);
+        }
+        else
+        {
+            // use DELETE and INSERT on pvs table as we may have the same pv name from a different IOC e.g. CAENSIM and CAEN
+            deleteDuplicatePVs(*con, *marg.pvm, getCleanupStrategy(), getEnvInt("PVDUMP_CLEANUP_CHUNK", static_cast<int>(batch_rows)));
+            delete_time = elapsedSince(insert_time);
+            // LOAD DATA can only replace whole rows, which would cascade delete pvinfo, so is not used for upsert 
+            if ( !(marg.bulk && !marg.upsert && bulkLoadPVs(*con, *marg.pvm, npv, ninfo, nstatements)) )
+            {
+                insertPVs(*con, *marg.pvm, marg.upsert, batch_rows, batch_bytes, npv, ninfo, nstatements);
+            }
+        }
+    }
+
+    const double pvs_time = elapsedSince(insert_time);
+    const epicsTime iocenv_time = epicsTime::getCurrent();
+    nmacro = writeIocEnv(*con, marg.evl, marg.bulk, batch_rows, batch_bytes, nstatements);
+    if (marg.incremental)
+    {
+        saveSnapshot(snapshotFileName(marg.mysql_host), new_fps, new_ioc_hash);
+    }
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        if (marg.seq == run_seq)
+        {
+            run_info.delete_time = delete_time;
+            run_info.insert_time = pvs_time - delete_time;
+            run_info.iocenv_time = elapsedSince(iocenv_time);
+            run_info.write_time = timer.elapsed();
+            run_info.npv_written = npv;
+            run_info.ninfo_written = ninfo;
+            run_info.nmacro = nmacro;
+            run_info.nstatements = nstatements;
+        }
+    }
+    finishRunInfo(marg.seq, 0);
+
+    std::cout << "pvdump: MySQL insert phase took " << pvs_time << " seconds" << std::endl;
+    std::cout << "pvdump: MySQL write of " << npv << " PVs with " << ninfo << " info entries, plus " << nmacro << " macros took " << timer.elapsed() << " seconds (" <<
+        nstatements << " statements, batch size " << batch_rows << ")" << std::endl;
+}
+
+// remove our old iocenv, iocrt and (unless updating in place) pvs rows and write iocrt, deciding how writeMysql() will
+// write the rest of margs
+static void setupMysql(MysqlThreadArgs& margs)
+{
+    PvdumpPhaseTimer timer("setup");
+    const int pid = margs.pid;
+    const std::string& exepath = margs.exe_path;
+    const char* mysqlHost = margs.mysql_host.c_str();
+    {
+        PooledConnection con(mysqlHost); // returned to the pool at the end of this block for writeMysql() to use
+
+        std::auto_ptr< sql::Statement > stmt(con->createStatement());
+        timedExecute(stmt.get(), std::string("DELETE FROM iocenv WHERE iocname='") + ioc_name + "' ORDER BY iocname,macroname");
+        std::ostringstream sql;
+        sql << "DELETE FROM iocrt WHERE iocname='" << ioc_name << "' OR pid=" << pid << " ORDER BY iocname"; // remove any old record from iocrt with our current pid or name
+        timedExecute(stmt.get(), sql.str());
+        margs.incremental = !margs.stream && incrementalSyncEnabled();
+        if (margs.incremental)
+        {
+            std::string snapshot_file = snapshotFileName(mysqlHost);
+            margs.have_snapshot = loadSnapshot(snapshot_file, margs.old_fps, margs.old_ioc_hash);
+            if (margs.have_snapshot)
+            {
+                // check the database still holds what the snapshot says we wrote last time, it may have been
+                // cleared or another IOC may have taken over some of our PV names
+                std::auto_ptr< sql::ResultSet > res(timedExecuteQuery(stmt.get(), std::string("SELECT COUNT(*) FROM pvs WHERE iocname='") + ioc_name + "'"));
+                if ( !res->next() || res->getUInt64(1) != margs.old_fps.size() )
+                {
+                    std::cout << "pvdump: database does not match snapshot, doing full write" << std::endl;
+                    margs.have_snapshot = false;
+                    margs.old_fps.clear();
+                }
+            }
+            // if the dump fails part way through the snapshot no longer describes the database
+            remove(snapshot_file.c_str());
+        }
+        margs.upsert = !margs.stream && upsertEnabled();
+        margs.bulk = bulkLoadEnabled();
+        if (!margs.have_snapshot && !margs.upsert)
+        {
+            timedExecute(stmt.get(), std::string("DELETE FROM pvs WHERE iocname='") + ioc_name + "' ORDER BY pvname"); // remove our PVS from last time, this will also delete records from pvinfo due to foreign key cascade action
+        }
+        con.commit();
+
+        sql::PreparedStatement* iocrt_stmt = con.prepare("INSERT INTO iocrt (iocname, pid, start_time, stop_time, running, exe_path) VALUES (?,?,NOW(),'1970-01-01 00:00:01',?,?)");
+        iocrt_stmt->setString(1,ioc_name);
+        iocrt_stmt->setInt(2,pid);
+        iocrt_stmt->setInt(3,1);
+        if (exepath.size() > MAX_IOC_PATH_LENGTH) {
+#ifdef _WIN32
+            char buffer[MAX_PATH + 1];
+            if (GetShortPathName(exepath.c_str(), buffer, MAX_PATH) != 0) {
+                buffer[MAX_IOC_PATH_LENGTH] = '\0';
+                iocrt_stmt->setString(4,buffer);
+            } else {
+                iocrt_stmt->setString(4,exepath.substr(0, MAX_IOC_PATH_LENGTH));
+            }
+#else
+            iocrt_stmt->setString(4,exepath.substr(0, MAX_IOC_PATH_LENGTH));
+#endif /* _WIN32 */
+        } else {
+            iocrt_stmt->setString(4,exepath);
+        }
+        timedExecuteUpdate(iocrt_stmt, "INSERT iocrt");
+        con.commit();
+    }
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        if (margs.seq == run_seq)
+        {
+            run_info.setup_time = timer.elapsed();
+        }
+    }
+    std::cout << "pvdump: MySQL setup took " << timer.elapsed() << " seconds" << std::endl;
+}
+
+/// When many IOCs boot together, spreads out and limits their database writes. The first write of an IOC is
+/// delayed by a random time of up to PVDUMP_START_DELAY seconds per 10000 PVs, up to PVDUMP_START_DELAY_MAX.
+/// Then, if PVDUMP_HOST_SLOTS is set, at most that many IOCs on this machine write at once, and if
+/// PVDUMP_FLEET_SLOTS is set at most that many IOCs writing to the server, using MySQL GET_LOCK().
+/// Slots are held until this object is destroyed. Nothing here throws, a problem just means less waiting.
+class PvdumpAdmission
+{
+public:
+    explicit PvdumpAdmission(const std::string& mysql_host) : m_mysql_host(mysql_host) { }
+    void admit(size_t npv)
+    {
+        PvdumpPhaseTimer timer("admission");
+        startDelay(npv);
+        const int host_slots = getEnvInt("PVDUMP_HOST_SLOTS", 0);
+        const int fleet_slots = getEnvInt("PVDUMP_FLEET_SLOTS", 0);
+        if (host_slots <= 0 && fleet_slots <= 0)
+        {
+            return;
+        }
+        const double timeout = getEnvInt("PVDUMP_ADMISSION_TIMEOUT", DEFAULT_ADMISSION_TIMEOUT);
+        const std::string host_prefix = localFileName("PVDUMP_LOCK_DIR", "pvdump_slot_");
+        bool host_ok = (host_slots <= 0), fleet_ok = (fleet_slots <= 0);
+        while(true)
+        {
+            if (!host_ok)
+            {
+                try
+                {
+                    host_ok = m_host_slot.tryAcquire(host_prefix, host_slots);
+                }
+                catch(const std::exception& e)
+                {
+                    errlogSevPrintf(errlogMinor, "pvdump: not limiting writes on this machine: %s\n", e.what());
+                    host_ok = true;
+                }
+            }
+            if (host_ok && !fleet_ok)
+            {
+                fleet_ok = tryFleetSlot(fleet_slots);
+            }
+            if (host_ok && fleet_ok)
+            {
+                break;
+            }
+            if (timer.elapsed() > timeout)
+            {
+                errlogSevPrintf(errlogMinor, "pvdump: no %s write slot after %g seconds, writing anyway\n", (host_ok ? "fleet" : "host"), timeout);
+                break;
+            }
+            epicsThreadSleep(ADMISSION_POLL * (0.5 + randomFraction()));
+        }
+        std::cout << "pvdump: admitted after " << timer.elapsed() << " seconds";
+        if (m_host_slot.held())
+        {
+            std::cout << ", host slot " << m_host_slot.slot();
+        }
+        if (!m_fleet_lock.empty())
+        {
+            std::cout << ", fleet lock " << m_fleet_lock;
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    std::string m_mysql_host;
+    PvdumpHostSlot m_host_slot;
+    std::auto_ptr<PvdumpConnection> m_lock_con; ///< our own session, not pooled, closing it releases the GET_LOCK() lock
+    std::string m_fleet_lock;
+
+    // random delay before the first write of the IOC, larger catalogs are spread over a longer time
+    void startDelay(size_t npv)
+    {
+        static bool first = true;
+        if (!first)
+        {
+            return;
+        }
+        first = false;
+        const double per_pvs = atof(getEnvString("PVDUMP_START_DELAY", "0").c_str());
+        if (per_pvs <= 0.0)
+        {
+            return;
+        }
+        const double max_delay = std::min(per_pvs * std::max(1.0, npv / START_DELAY_PVS), atof(getEnvString("PVDUMP_START_DELAY_MAX", "60").c_str()));
+        const double delay = max_delay * randomFraction();
+        std::cout << "pvdump: waiting " << delay << " seconds before first database write" << std::endl;
+        epicsThreadSleep(delay);
+    }
+
+    bool tryFleetSlot(int fleet_slots)
+    {
+        try
+        {
+            if (m_lock_con.get() == NULL)
+            {
+                m_lock_con.reset(new PvdumpConnection(m_mysql_host));
+            }
+            sql::PreparedStatement* lock_stmt = m_lock_con->prepare("SELECT GET_LOCK(?, 0)");
+            // start at a random slot so waiting IOCs do not all try slot 0 first
+            const int first = static_cast<int>(fleet_slots * randomFraction());
+            for(int i = 0; i < fleet_slots; ++i)
+            {
+                std::ostringstream name;
+                name << "pvdump_slot_" << (first + i) % fleet_slots;
+                lock_stmt->setString(1, name.str());
+                std::auto_ptr< sql::ResultSet > res(timedExecuteQuery(lock_stmt, "SELECT GET_LOCK"));
+                if (res->next() && res->getInt(1) == 1)
+                {
+                    m_fleet_lock = name.str();
+                    return true;
+                }
+            }
+            return false;
+        }
+        catch(const std::exception& e)
+        {
+            errlogSevPrintf(errlogMinor, "pvdump: not limiting writes across IOCs: %s\n", e.what());
+            m_lock_con.reset();
+            return true;
+        }
+    }
+};
+
+// write a pvdump request to MySQL, a failure ends the pvdump
+static void writeRequest(MysqlThreadArgs& marg)
+{
+	try
+	{
+        PvdumpAdmission admission(marg.mysql_host);
+        admission.admit(marg.pvm.valid() ? marg.pvm->size() : 0);
+        setupMysql(marg);
+        writeMysql(marg);
+    }
+	catch (sql::SQLException &e)
+	{
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
+        finishRunInfo(marg.seq, -1);
+	}
+	catch (std::runtime_error &e)
+	{
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s\n", e.what());
+        finishRunInfo(marg.seq, -1);
+	}
+    catch(...)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
+        finishRunInfo(marg.seq, -1);
+    }
+}
+
+static epicsMutex spool_mutex;
+static PvdumpSpool* spool = NULL; ///< opened by the first spoolSnapshot()
+
+/// All database writes are done by a single writer thread, started by the first pvdump. It takes the
+/// latest request, or if there is none and spooling is on the newest spooled snapshot of our IOC.
+static epicsMutex writer_mutex;
+static epicsEvent writer_event; ///< signalled when there is a new request or spooled snapshot
+static bool writer_started = false;
+static MysqlThreadArgs* pending_write = NULL; ///< request the writer has not started, replaced by a newer one
+static bool writer_busy = false; ///< writing a request rather than a spooled snapshot
+static int spool_waiting = 0; ///< snapshots of our IOC in the spool
+static bool live_flush_requested = false; ///< the live update timer has expired
+static long long spool_last_id = 0; ///< spool id and pvdump sequence number of the last snapshot we spooled
+static unsigned long spool_last_seq = 0;
+static bool spool_superseded = false; ///< the last dump could not be spooled so was written directly, any snapshot spooled before it is out of date
+
+// PVDUMP_SPOOL=on commits each dump to a local SQLite file which the writer thread then writes to MySQL,
+// so the IOC does not wait for, or need, the MySQL server to boot
+static bool spoolEnabled()
+{
+    std::string mode = getEnvString("PVDUMP_SPOOL", "off");
+    if (mode != "off" && mode != "on")
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: unknown PVDUMP_SPOOL mode \"%s\" (expected off or on), using off\n", mode.c_str());
+    }
+    return (mode == "on");
+}
+
+// writes waiting or in progress
+static void publishQueueDepth()
+{
+    int depth;
+    {
+        epicsGuard<epicsMutex> _lock(writer_mutex);
+        depth = (pending_write != NULL ? 1 : 0) + (writer_busy ? 1 : 0) + spool_waiting;
+    }
+    PvdumpStatus::instance().setQueueDepth(depth);
+}
+
+// write the newest spooled snapshot of our IOC to MySQL, removing it from the spool. One older than a dump
+// written directly, see spoolSnapshot(), is just removed.
+// Returns 1 if one was written, 0 if there are none and -1 if it could not be written.
+static int drainSpool(PvdumpSpool* sp)
+{
+    PvdumpSpoolEntry entry;
+    try
+    {
+        if (!sp->readLatest(ioc_name, entry))
+        {
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            spool_waiting = 0;
+            return 0;
+        }
+        bool superseded;
+        {
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            superseded = spool_superseded;
+        }
+        if (superseded)
+        {
+            sp->remove(entry.id);
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            spool_waiting = 0;
+            return 0;
+        }
+        MysqlThreadArgs margs(PVCatalogRef(entry.pvm), entry.evl, macEnvExpand("$(MYSQLHOST=localhost)"));
+        margs.pid = entry.pid;
+        margs.exe_path = entry.exe_path;
+        {
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            margs.seq = (entry.id == spool_last_id ? spool_last_seq : 0);
+        }
+        PvdumpAdmission admission(margs.mysql_host);
+        admission.admit(margs.pvm->size());
+        setupMysql(margs);
+        writeMysql(margs);
+        sp->remove(entry.id);
+        int waiting = sp->count(ioc_name);
+        epicsGuard<epicsMutex> _lock(writer_mutex);
+        spool_waiting = waiting;
+        return 1;
+    }
+    catch (sql::SQLException &e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
+    }
+    catch (std::runtime_error &e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s\n", e.what());
+    }
+    catch(...)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
+    }
+    return -1;
+}
+
+/// Changes logged after the first pvdump are written after liveInterval() seconds, so a burst of
+/// changes goes as one small update. The timer is started by the first change after a write.
+class LiveUpdateTimer : public epicsTimerNotify
+{
+public:
+    LiveUpdateTimer() : m_timer(epicsTimerQueueActive::allocate(true, epicsThreadPriorityLow).createTimer()), m_armed(false) { }
+    /// start the timer unless it is already running, called without pv_map_mutex held
+    void arm()
+    {
+        {
+            epicsGuard<epicsMutex> _lock(m_lock);
+            if (m_armed)
+            {
+                return;
+            }
+            m_armed = true;
+        }
+        m_timer.start(*this, liveInterval());
+    }
+    expireStatus expire(const epicsTime&)
+    {
+        {
+            epicsGuard<epicsMutex> _lock(m_lock);
+            m_armed = false;
+        }
+        {
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            live_flush_requested = true;
+        }
+        writer_event.signal();
+        return expireStatus(noRestart);
+    }
+private:
+    epicsMutex m_lock;
+    epicsTimer& m_timer;
+    bool m_armed;
+};
+
+static LiveUpdateTimer& liveUpdateTimer()
+{
+    // never deleted, the timer queue thread may still be running at exit
+    static LiveUpdateTimer* timer = new LiveUpdateTimer;
+    return *timer;
+}
+
+// delete rows of pvs with the given names in chunks of chunk_rows, our own rows if own is set or else those
+// of other IOCs, without committing
+static void deleteNamedPVs(PvdumpConnection& con, const std::vector<std::string>& names, bool own, size_t chunk_rows, unsigned long& nstatements)
+{
+    for(size_t i = 0; i < names.size(); i += chunk_rows)
+    {
+        const size_t n = std::min(chunk_rows, names.size() - i);
+        std::vector<std::string> values(names.begin() + i, names.begin() + i + n);
+        values.push_back(ioc_name);
+        std::auto_ptr< sql::PreparedStatement > pstmt(con->prepareStatement(inListDeleteSQL(n, own)));
+        timedExecuteUpdate(pstmt.get(), values, "DELETE pvs");
+        ++nstatements;
+    }
+}
+
+// write the current state of PVs changed since the last live update, PVs no longer in pv_map are deleted
+static void writeLiveChanges()
+{
+    std::set<std::string> changes;
+    PVCatalog changed;
+    std::vector<std::string> removed;
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        changes.swap(live_changes);
+        if (changes.empty())
+        {
+            return;
+        }
+        pv_map.finalize();
+        for(std::set<std::string>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+        {
+            size_t i = pv_map.find(it->c_str());
+            if (i != PVCatalog::npos)
+            {
+                changed.addFrom(pv_map, i);
+            }
+            else
+            {
+                removed.push_back(*it);
+            }
+        }
+    }
+    changed.finalize();
+    const std::string mysql_host = macEnvExpand("$(MYSQLHOST=localhost)");
+    try
+    {
+        PvdumpPhaseTimer timer("live update");
+        PooledConnection con(mysql_host.c_str());
+        const size_t batch_rows = getSetting(pvdumpBatchRows, "PVDUMP_BATCH_ROWS", DEFAULT_BATCH_ROWS);
+        const size_t batch_bytes = getSetting(pvdumpBatchBytes, "PVDUMP_BATCH_BYTES", DEFAULT_BATCH_BYTES);
+        unsigned long npv = 0, ninfo = 0, nstatements = 0;
+        // the snapshot of the last full write will no longer describe the database
+        remove(snapshotFileName(mysql_host).c_str());
+        std::vector<std::string> names(changes.begin(), changes.end());
+        std::vector<std::string> present;
+        present.reserve(changed.size());
+        for(size_t i = 0; i < changed.size(); ++i)
+        {
+            present.push_back(changed.name(i));
+        }
+        const size_t chunk_rows = std::max(static_cast<size_t>(1), std::min(batch_rows, static_cast<size_t>(MAX_PLACEHOLDERS - 1)));
+        double pvs_time = 0.0, pvinfo_time = 0.0;
+        // one transaction, so a PV that was only edited is never missing from pvs and pvinfo
+        for(int attempt = 1; ; ++attempt)
+        {
+            unsigned long chunk_npv = 0, chunk_ninfo = 0, chunk_statements = 0;
+            try
+            {
+                // our own rows of changed PVs go too, as they may already be there e.g. when an info field is
+                // added, pvinfo rows go with them by the foreign key cascade
+                deleteNamedPVs(*con, names, true, chunk_rows, chunk_statements);
+                if (!changed.empty())
+                {
+                    deleteNamedPVs(*con, present, false, chunk_rows, chunk_statements);
+                    // insert rather than upsert after the deletes above, so info fields the PV no longer has go too
+                    insertChunk(*con, changed, 0, changed.size(), false, batch_rows, batch_bytes, chunk_npv, chunk_ninfo, chunk_statements, pvs_time, pvinfo_time);
+                }
+                con.commit();
+            }
+            catch (sql::SQLException &e)
+            {
+                if (!retryAfterLockError(*con, e, attempt, "live update"))
+                {
+                    throw;
+                }
+                continue;
+            }
+            npv = chunk_npv;
+            ninfo = chunk_ninfo;
+            nstatements = chunk_statements;
+            break;
+        }
+        PvdumpStats::instance().addPhase("insert pvs", pvs_time);
+        PvdumpStats::instance().addPhase("insert pvinfo", pvinfo_time);
+        std::cout << "pvdump: live update wrote " << npv << " PVs with " << ninfo << " info entries and removed " << removed.size() <<
+            " PVs in " << timer.elapsed() << " seconds (" << nstatements << " statements)" << std::endl;
+        return;
+    }
+    catch (sql::SQLException &e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: live update MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
+    }
+    catch (std::exception &e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: live update ERR: %s\n", e.what());
+    }
+    // put the changes back, along with any made since, for the next attempt
+    PvdumpStatus::instance().addRetry();
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        live_changes.insert(changes.begin(), changes.end());
+    }
+    liveUpdateTimer().arm();
+}
+
+static void writerThread(void*)
+{
+    const double min_delay = std::max(MIN_SPOOL_RETRY, atof(getEnvString("PVDUMP_SPOOL_RETRY", "10").c_str()));
+    const double max_delay = atof(getEnvString("PVDUMP_SPOOL_RETRY_MAX", "300").c_str());
+    double delay = min_delay;
+    for(;;)
+    {
+        std::auto_ptr<MysqlThreadArgs> marg;
+        PvdumpSpool* sp;
+        {
+            epicsGuard<epicsMutex> _lock(writer_mutex);
+            marg.reset(pending_write);
+            pending_write = NULL;
+            writer_busy = (marg.get() != NULL);
+        }
+        if (marg.get() != NULL)
+        {
+            publishQueueDepth();
+            writeRequest(*marg);
+            {
+                epicsGuard<epicsMutex> _lock(writer_mutex);
+                writer_busy = false;
+            }
+            publishQueueDepth();
+            continue;
+        }
+        {
+            epicsGuard<epicsMutex> _lock(spool_mutex);
+            sp = spool;
+        }
+        int ret = (sp != NULL ? drainSpool(sp) : 0);
+        publishQueueDepth();
+        if (ret > 0)
+        {
+            delay = min_delay;
+        }
+        else if (ret == 0)
+        {
+            delay = min_delay;
+            // live updates wait until any full write and spooled snapshot are done, as those would replace them
+            bool flush_live;
+            {
+                epicsGuard<epicsMutex> _lock(writer_mutex);
+                flush_live = live_flush_requested && pending_write == NULL;
+                if (flush_live)
+                {
+                    live_flush_requested = false;
+                }
+            }
+            if (flush_live)
+            {
+                writeLiveChanges();
+                continue;
+            }
+            writer_event.wait();
+        }
+        else
+        {
+            PvdumpStatus::instance().addRetry();
+            errlogSevPrintf(errlogMinor, "pvdump: spooled snapshot not written, retrying in %g seconds\n", delay);
+            writer_event.wait(delay); // a new request also wakes us
+            delay = std::min(2.0 * delay, std::max(min_delay, max_delay));
+        }
+    }
+}
+
+// hand a request to the writer thread, replacing any request it has not yet started. With a NULL
+// request the writer just checks the spool. Returns false if the writer thread cannot be started.
+static bool queueWrite(MysqlThreadArgs* margs)
+{
+    std::auto_ptr<MysqlThreadArgs> superseded;
+    {
+        epicsGuard<epicsMutex> _lock(writer_mutex);
+        if (!writer_started)
+        {
+            if (epicsThreadCreate("pvdump", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                                   writerThread, NULL) == 0)
+            {
+                delete margs;
+                return false;
+            }
+            writer_started = true;
+        }
+        if (margs != NULL)
+        {
+            superseded.reset(pending_write);
+            pending_write = margs;
+        }
+    }
+    if (superseded.get() != NULL)
+    {
+        std::cout << "pvdump: replacing a queued write that had not started" << std::endl;
+    }
+    publishQueueDepth();
+    writer_event.signal();
+    return true;
+}
+
+// commit the dump to the local spool file for the writer thread to write to MySQL. Returns false if it cannot be
+// spooled, e.g. the disk is full, for the caller to write it directly instead
+static bool spoolSnapshot(const PVCatalog& pv_map, int pid, const std::string& exepath, unsigned long seq)
+{
+    try
+    {
+        PvdumpPhaseTimer timer("spool");
+        long long id;
+        int waiting;
+        {
+            epicsGuard<epicsMutex> _lock(spool_mutex);
+            if (spool == NULL)
+            {
+                spool = new PvdumpSpool(localFileName("PVDUMP_SPOOL_DIR", "pvdump_spool.db"));
+            }
+            id = spool->write(ioc_name, pid, exepath, pv_map, environ_list);
+            waiting = spool->count(ioc_name);
+            std::cout << "pvdump: spooled " << pv_map.size() << " PVs to \"" << spool->fileName() << "\" in " << timer.elapsed() << " seconds" << std::endl;
+        }
+        epicsGuard<epicsMutex> _lock(writer_mutex);
+        spool_last_id = id;
+        spool_last_seq = seq;
+        spool_waiting = waiting;
+        spool_superseded = false;
+    }
+    catch (std::exception &e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: spool ERR: %s, writing to MySQL directly\n", e.what());
+        epicsGuard<epicsMutex> _lock(writer_mutex);
+        spool_superseded = true;
+        return false;
+    }
+    return true;
+}
+#endif /* PVDUMP_DUMMY */
+
+// after a pvdump, log the PVs changed for the next live update. Called with pv_map_mutex held, returns true
+// if there is now something to write
+static bool logLiveChanges(int n, const char* const* pvnames)
+{
+    if (!live_active)
+    {
+        return false;
+    }
+    for(int i = 0; i < n; ++i)
+    {
+        if (pvnames[i] != NULL)
+        {
+            live_changes.insert(pvnames[i]);
+        }
     }
-	catch (sql::SQLException &e) 
-	{
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
-	} 
-	catch (std::runtime_error &e)
-	{
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s\n", e.what());
-	}
-    catch(...)
+    return (n > 0);
+}
+
+// start the live update timer if logLiveChanges() said so, called without pv_map_mutex held
+static void startLiveUpdate(bool start)
+{
+#ifndef PVDUMP_DUMMY
+    if (start)
     {
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
+        liveUpdateTimer().arm();
     }
+#else
+    (void)start;
 #endif /* PVDUMP_DUMMY */
 }
 
+// begin logging changes to pv_map, if live updates are on. Called with pv_map_mutex held as the PVs for a
+// full write are taken, so there is no gap in which a change is neither in the write nor logged
+static void activateLiveUpdates()
+{
+#ifndef PVDUMP_DUMMY
+    live_active = (liveInterval() > 0.0);
+#endif /* PVDUMP_DUMMY */
+}
 
-static int dumpMysql(const std::map<std::string,PVInfo>& pv_map, int pid, const std::string& exepath)
+// an empty pvs reference means the writer thread is to scan the IOC itself, see streamScanEnabled()
+static int dumpMysql(const PVCatalogRef& pvs, int pid, const std::string& exepath, unsigned long seq)
 {
-	unsigned long npv = 0, ninfo = 0, nmacro = 0;
-	const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
+    if (pvs.valid())
+    {
+        epicsGuard<epicsMutex> _lock(run_info_mutex);
+        run_info.npv = static_cast<unsigned long>(pvs->size());
+        run_info.ninfo = static_cast<unsigned long>(pvs->infoCount());
+    }
+    environ_list.clear();
+    for (char** sp = environ ; (sp != NULL) && (*sp != NULL) ; ++sp)
+    {
+        environ_list.push_back(*sp); // name=value string
+    }
 #ifndef PVDUMP_DUMMY
-	try 
-	{
-        const clock_t begin_time = clock();
-        if (mysql_driver == NULL)
-        {
-	        mysql_driver = sql::mysql::get_driver_instance();
-        }
-	    sql::Connection* con = mysql_driver->connect(mysqlHost, "iocdb", "$iocdb");
-        // the ORDER BY is to make deletes happen in a consistent primary key order, and so try and avoid deadlocks
-        // but it may not be completely right. Additional indexes have also been added to database tables.
-	    con->setAutoCommit(0); // we will create transactions ourselves via explicit calls to con->commit()
-	    con->setSchema("iocdb");
-        
-        environ_list.clear();
-        for (char** sp = environ ; (sp != NULL) && (*sp != NULL) ; ++sp)
-		{
-		    environ_list.push_back(*sp); // name=value string
-        }
-        
-	    std::auto_ptr< sql::Statement > stmt(con->createStatement());
-		stmt->execute(std::string("DELETE FROM iocenv WHERE iocname='") + ioc_name + "' ORDER BY iocname,macroname");
-		std::ostringstream sql;
-		sql << "DELETE FROM iocrt WHERE iocname='" << ioc_name << "' OR pid=" << pid << " ORDER BY iocname"; // remove any old record from iocrt with our current pid or name
-		stmt->execute(sql.str());
-		stmt->execute(std::string("DELETE FROM pvs WHERE iocname='") + ioc_name + "' ORDER BY pvname"); // remove our PVS from last time, this will also delete records from pvinfo due to foreign key cascade action
-		con->commit();
-		
-		std::auto_ptr< sql::PreparedStatement > iocrt_stmt(con->prepareStatement("INSERT INTO iocrt (iocname, pid, start_time, stop_time, running, exe_path) VALUES (?,?,NOW(),'1970-01-01 00:00:01',?,?)"));
-		iocrt_stmt->setString(1,ioc_name);
-		iocrt_stmt->setInt(2,pid);
-		iocrt_stmt->setInt(3,1);
-        if (exepath.size() > MAX_IOC_PATH_LENGTH) {
-#ifdef _WIN32
-            char buffer[MAX_PATH + 1];
-            if (GetShortPathName(exepath.c_str(), buffer, MAX_PATH) != 0) {
-                buffer[MAX_IOC_PATH_LENGTH] = '\0';
-		        iocrt_stmt->setString(4,buffer);
-            } else {
-		        iocrt_stmt->setString(4,exepath.substr(0, MAX_IOC_PATH_LENGTH));
-            }
-#else
-		    iocrt_stmt->setString(4,exepath.substr(0, MAX_IOC_PATH_LENGTH));
-#endif /* _WIN32 */
-        } else {
-		    iocrt_stmt->setString(4,exepath);
-        }
-		iocrt_stmt->executeUpdate();
-		con->commit();
-        delete con;
-        epicsThreadSleep(0.1);
-        MysqlThreadArgs* margs = new MysqlThreadArgs(pv_map, environ_list, mysqlHost);
-        epicsThreadCreate("pvdump", epicsThreadPriorityMedium, epicsThreadStackMedium, 
-                           dumpMysqlThread, margs);
-        std::cout << "pvdump: MySQL setup took " << float( clock () - begin_time ) /  CLOCKS_PER_SEC << " seconds" << std::endl;
+    // all database work, including removing our old rows, is done by the writer thread so IOC boot does not wait for MySQL.
+    // With no request it writes the snapshot just spooled
+    MysqlThreadArgs* margs = NULL;
+    if ( !(pvs.valid() && spoolEnabled() && spoolSnapshot(*pvs, pid, exepath, seq)) )
+    {
+	    const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
+        margs = new MysqlThreadArgs(pvs, environ_list, mysqlHost);
+        margs->pid = pid;
+        margs->exe_path = exepath;
+        margs->seq = seq;
+        margs->stream = !pvs.valid();
     }
-	catch (sql::SQLException &e) 
-	{
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
-        return -1;
-	} 
-	catch (std::runtime_error &e)
-	{
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: %s\n", e.what());
-        return -1;
-	}
-    catch(...)
+    if (!queueWrite(margs))
     {
-        errlogSevPrintf(errlogMinor, "pvdump: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
+        errlogSevPrintf(errlogMinor, "pvdump: ERROR: cannot create writer thread\n");
+        finishRunInfo(seq, -1);
         return -1;
     }
+#else
+    (void)pid;
+    (void)exepath;
+    finishRunInfo(seq, 0);
 #endif /* PVDUMP_DUMMY */
 	return 0;
 }
 
-static int pvdump(const char *dbName, const char *iocName)
+static int pvdump(const char *dbName, const char *iocName, const char *loadMode)
 {
     static int first_call = 1;
     int pid = get_pid();
@@ -411,27 +2914,60 @@ static int pvdump(const char *dbName, const char *iocName)
 	    ioc_name = getIOCName();
 	}
 	printf("pvdump: ioc name is \"%s\" pid %d\n", ioc_name.c_str(), pid);
+    if (loadMode != NULL && *loadMode != '\0')
+    {
+        load_mode = loadMode;
+    }
+    const unsigned long seq = startRunInfo();
     const char* epicsRoot = macEnvExpand("$(EPICS_ROOT)");
 	if (NULL == epicsRoot)
 	{
         errlogSevPrintf(errlogMinor, "pvdump: ERROR: EPICS_ROOT is NULL - cannot continue\n");
+        finishRunInfo(seq, -1);
 	    return -1;
 	}
     
     //PV stuff
-	try
-	{
-		dump_pvs(NULL, NULL, pv_map);
-	}
-	catch(const std::exception& ex)
-	{
-        errlogSevPrintf(errlogMinor, "pvdump: ERROR: %s\n", ex.what());
-		return -1;
-	}
-	int ret = dumpMysql(pv_map, pid, exepath);
+    PVCatalogRef scanned;
+    bool stream = false;
+#ifndef PVDUMP_DUMMY
+    // the records cannot change once iocInit is done, so only then can the writer scan them in the background
+    stream = (pdbbase != NULL && interruptAccept && streamScanEnabled() && !spoolEnabled());
+#endif /* PVDUMP_DUMMY */
+    if (stream)
+    {
+        std::cout << "pvdump: scanning and writing PVs in chunks" << std::endl;
+        pv_catalog.publish(PVCatalogRef()); // no catalog is kept, the scan counts are in run_info
+    }
+    else
+    {
+	    try
+	    {
+            PvdumpPhaseTimer timer("scan");
+            PVCatalog pvs;
+		    dump_pvs(NULL, NULL, pvs);
+            pvs.report(stdout);
+            scanned = PVCatalogRef(pvs);
+            pv_catalog.publish(scanned);
+            epicsGuard<epicsMutex> _lock(run_info_mutex);
+            run_info.scan_time = timer.elapsed();
+	    }
+	    catch(const std::exception& ex)
+	    {
+            errlogSevPrintf(errlogMinor, "pvdump: ERROR: %s\n", ex.what());
+            finishRunInfo(seq, -1);
+		    return -1;
+	    }
+    }
+    {
+        // pv_map is not part of the scan above, so log changes to it from before the write is queued
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        activateLiveUpdates();
+    }
+	int ret = dumpMysql(scanned, pid, exepath, seq);
 	if (ret == 0)
 	{
-	    // only install exit handler if we connect OK to mysql 
+	    // only install exit handler if the writer was started
 	    if (first_call)
 	    {
             epicsAtExit(pvdumpOnExit, NULL); // register exit handler to change "running" state etc. in db
@@ -441,89 +2977,157 @@ static int pvdump(const char *dbName, const char *iocName)
     return 0;
 }
 
-static void pvdumpOnExit(void*)
-{
-    time_t currtime;
-    time(&currtime);
-	printf("pvdump: calling exit handler for ioc \"%s\"\n", ioc_name.c_str());
-    const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
 #ifndef PVDUMP_DUMMY
+/// the iocrt update done at exit, on its own thread so the exit handler can give up on it
+struct ExitUpdate
+{
+    std::string mysql_host;
+    std::string sql;
+    epicsEvent done;
+    ExitUpdate(const std::string& mysql_host_, const std::string& sql_) : mysql_host(mysql_host_), sql(sql_) { }
+};
+
+static void pvdumpExitThread(void* arg)
+{
+    ExitUpdate* upd = static_cast<ExitUpdate*>(arg);
 	try
 	{
-        if (mysql_driver == NULL)
-        {
-	        mysql_driver = sql::mysql::get_driver_instance();
-        }
-		std::auto_ptr< sql::Connection > con(mysql_driver->connect(mysqlHost, "iocdb", "$iocdb"));
+        PvdumpPhaseTimer timer("exit");
+		PooledConnection con(upd->mysql_host);
 		std::auto_ptr< sql::Statement > stmt(con->createStatement());
-		con->setSchema("iocdb");
-	    std::ostringstream sql;
-		sql << "UPDATE iocrt SET pid=NULL, start_time=start_time, stop_time=NOW(), running=0 WHERE iocname='" << ioc_name << "'";
-		stmt->execute(sql.str());
+		timedExecute(stmt.get(), upd->sql);
+		con.commit();
 	}
 	// not sure of state of EPICS errlog during exit handlers, so use plain old stderr for safety
 	catch (sql::SQLException &e) 
 	{
 		fprintf(stderr, "pvdump: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
-        return;
 	} 
 	catch (std::runtime_error &e)
 	{
 		fprintf(stderr, "pvdump: MySQL ERR: %s\n", e.what());
-        return;
 	}
     catch(...)
     {
 		fprintf(stderr, "pvdump: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
+    }
+    upd->done.signal();
+}
+#endif /* PVDUMP_DUMMY */
+
+// mark the IOC as stopped in iocrt, waiting at most PVDUMP_EXIT_TIMEOUT seconds so a slow or unreachable server
+// cannot hold up IOC exit
+static void pvdumpOnExit(void*)
+{
+    time_t currtime;
+    time(&currtime);
+	printf("pvdump: calling exit handler for ioc \"%s\"\n", ioc_name.c_str());
+#ifndef PVDUMP_DUMMY
+    const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
+    std::ostringstream sql;
+    sql << "UPDATE iocrt SET pid=NULL, start_time=start_time, stop_time=NOW(), running=0 WHERE iocname='" << ioc_name << "'";
+    const double timeout = getEnvInt("PVDUMP_EXIT_TIMEOUT", DEFAULT_EXIT_TIMEOUT);
+    // never deleted, the thread may still be using it if we give up waiting
+    ExitUpdate* upd = new ExitUpdate(mysqlHost, sql.str());
+    if (epicsThreadCreate("pvdumpExit", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                          pvdumpExitThread, upd) == 0)
+    {
+		fprintf(stderr, "pvdump: cannot create exit thread, iocrt not updated\n");
         return;
     }
+    if (!upd->done.wait(timeout))
+    {
+		fprintf(stderr, "pvdump: iocrt not updated within %g seconds, giving up\n", timeout);
+    }
 #endif /* PVDUMP_DUMMY */
 }
 
+#ifndef PVDUMP_DUMMY
+static void sqlexecProgress(const PvdumpSqlScript& script, unsigned long nstatements, double elapsed)
+{
+    std::ostringstream done;
+    if (script.size() > 0)
+    {
+        done << " (" << std::fixed << std::setprecision(1) << 100.0 * script.bytesRead() / script.size() << "%)";
+    }
+    std::cout << "sqlexec: " << nstatements << " statements from " << script.lines() << " lines" << done.str() << " in " << elapsed
+              << " seconds, " << (elapsed > 0.0 ? nstatements / elapsed : 0.0) << " statements/s" << std::endl;
+}
+#endif /* PVDUMP_DUMMY */
+
 // allow a file of SQL commands to be executed from the IOC command line
-// all lines are executed in a single transaction
-static int sqlexec(const char *fileName)
+// statements end with ; (or as set by DELIMITER) and may span lines, a script with no ; or DELIMITER at all
+// is run a line at a time as before. They are all executed in a single transaction unless commit_every (or
+// PVDUMP_SQLEXEC_COMMIT) is set, when a commit is made after each commit_every statements. Progress is printed every PVDUMP_SQLEXEC_PROGRESS seconds, default 10
+static int sqlexec(const char *fileName, int commit_every)
 {
-	const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
-	int nlines = 0;
 	if (fileName == NULL || *fileName == '\0')
 	{
         errlogSevPrintf(errlogMinor, "sqlexec: No filename given\n");
 		return -1;
 	}
 #ifndef PVDUMP_DUMMY
+	const char* mysqlHost = macEnvExpand("$(MYSQLHOST=localhost)");
+    commit_every = getSetting(commit_every, "PVDUMP_SQLEXEC_COMMIT", 0);
+    const double progress_interval = atof(getEnvString("PVDUMP_SQLEXEC_PROGRESS", "10").c_str());
+    unsigned long nstatements = 0, ncommitted = 0;
 	try 
 	{
-        const clock_t begin_time = clock();
-        if (mysql_driver == NULL)
+        PvdumpPhaseTimer timer("sqlexec");
+        PvdumpSqlScript script(fileName);
+        if (script.lineMode())
         {
-	        mysql_driver = sql::mysql::get_driver_instance();
+            std::cout << "sqlexec: no ; or DELIMITER in \"" << fileName << "\", executing each line as a statement" << std::endl;
         }
-	    std::auto_ptr< sql::Connection > con(mysql_driver->connect(mysqlHost, "iocdb", "$iocdb"));
-	    con->setAutoCommit(0); // we will create transactions ourselves via explicit calls to con->commit()
-	    con->setSchema("iocdb");
+        // a connection of its own rather than one from the pool, as a script may change the schema, autocommit or
+        // other session state that later writes rely on. It is closed at the end, rolling back anything uncommitted
+        PvdumpConnection con(mysqlHost);
 	    std::auto_ptr< sql::Statement > stmt(con->createStatement());
-		std::fstream fs;
-		char buffer[256];
-		fs.open(fileName, std::ios::in);
-		fs.getline(buffer, sizeof(buffer));
-		while(fs.good())
+        double last_progress = 0.0;
+        std::string statement;
+		while(script.next(statement))
 		{
-		    ++nlines;
-			stmt->execute(std::string(buffer));
-		    fs.getline(buffer, sizeof(buffer));
+            try
+            {
+			    timedExecute(stmt.get(), statement);
+            }
+            catch(const std::exception&)
+            {
+                errlogSevPrintf(errlogMinor, "sqlexec: statement %lu at line %lu of \"%s\" failed: %.200s\n", nstatements + 1,
+                                script.statementLine(), fileName, statement.c_str());
+                throw;
+            }
+		    ++nstatements;
+            if (commit_every > 0 && nstatements % commit_every == 0)
+            {
+                con.commit();
+                ncommitted = nstatements;
+            }
+            if (progress_interval > 0.0 && timer.elapsed() - last_progress >= progress_interval)
+            {
+                last_progress = timer.elapsed();
+                sqlexecProgress(script, nstatements, last_progress);
+            }
 		}
-        con->commit();
-        std::cout << "sqlexec: executing " << nlines << " lines of SQL from \"" << fileName << "\" took " << float( clock () - begin_time ) /  CLOCKS_PER_SEC << " seconds" << std::endl;
+        con.commit();
+        std::cout << "sqlexec: executing " << nstatements << " statements from " << script.lines() << " lines of SQL in \"" << fileName << "\" took " << timer.elapsed() << " seconds" << std::endl;
     }
 	catch (sql::SQLException &e) 
 	{
         errlogSevPrintf(errlogMinor, "sqlexec: MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr());
+        if (ncommitted > 0)
+        {
+            errlogSevPrintf(errlogMinor, "sqlexec: the first %lu statements were committed\n", ncommitted);
+        }
         return -1;
 	} 
 	catch (std::runtime_error &e)
 	{
         errlogSevPrintf(errlogMinor, "sqlexec: MySQL ERR: %s\n", e.what());
+        if (ncommitted > 0)
+        {
+            errlogSevPrintf(errlogMinor, "sqlexec: the first %lu statements were committed\n", ncommitted);
+        }
         return -1;
 	}
     catch(...)
@@ -531,6 +3135,8 @@ static int sqlexec(const char *fileName)
         errlogSevPrintf(errlogMinor, "sqlexec: MySQL ERR: FAILED TRYING TO WRITE TO THE ISIS PV DB\n");
         return -1;
     }
+#else
+    (void)commit_every;
 #endif /* PVDUMP_DUMMY */
     return 0;
 }
@@ -539,23 +3145,93 @@ static int sqlexec(const char *fileName)
 
 static const iocshArg pvdump_initArg0 = { "dbname", iocshArgString };			///< The name of the database
 static const iocshArg pvdump_initArg1 = { "iocname", iocshArgString };
+static const iocshArg pvdump_initArg2 = { "loadmode", iocshArgString };			///< "insert" or "bulk", default from PVDUMP_LOAD
 
 static const iocshArg sqlexec_initArg0 = { "filename", iocshArgString };			///< The name of the sql commands file
+static const iocshArg sqlexec_initArg1 = { "commit", iocshArgInt };			///< statements per transaction, default from PVDUMP_SQLEXEC_COMMIT or all in one
+
+static const iocshArg pvdumpStats_initArg0 = { "level", iocshArgInt };			///< 0 phases, 1 adds statements, 2 adds histograms
+static const iocshArg pvdumpStats_initArg1 = { "reset", iocshArgInt };			///< if non-zero, clear statistics after printing them
+static const iocshArg pvdumpWait_initArg0 = { "timeout", iocshArgDouble };			///< seconds, 0 to wait until finished
 
-static const iocshArg * const pvdump_initArgs[] = { &pvdump_initArg0, &pvdump_initArg1 };
-static const iocshArg * const sqlexec_initArgs[] = { &sqlexec_initArg0 };
+static const iocshArg * const pvdump_initArgs[] = { &pvdump_initArg0, &pvdump_initArg1, &pvdump_initArg2 };
+static const iocshArg * const sqlexec_initArgs[] = { &sqlexec_initArg0, &sqlexec_initArg1 };
+static const iocshArg * const pvdumpStats_initArgs[] = { &pvdumpStats_initArg0, &pvdumpStats_initArg1 };
+static const iocshArg * const pvdumpWait_initArgs[] = { &pvdumpWait_initArg0 };
 
 static const iocshFuncDef pvdump_initFuncDef = {"pvdump", sizeof(pvdump_initArgs) / sizeof(iocshArg*), pvdump_initArgs};
 static const iocshFuncDef sqlexec_initFuncDef = {"sqlexec", sizeof(sqlexec_initArgs) / sizeof(iocshArg*), sqlexec_initArgs};
+static const iocshFuncDef pvdumpStats_initFuncDef = {"pvdumpStats", sizeof(pvdumpStats_initArgs) / sizeof(iocshArg*), pvdumpStats_initArgs};
+static const iocshFuncDef pvdumpWait_initFuncDef = {"pvdumpWait", sizeof(pvdumpWait_initArgs) / sizeof(iocshArg*), pvdumpWait_initArgs};
+static const iocshFuncDef pvdumpStatus_initFuncDef = {"pvdumpStatus", 0, NULL};
 
 static void pvdump_initCallFunc(const iocshArgBuf *args)
 {
-    pvdump(args[0].sval, args[1].sval);
+    pvdump(args[0].sval, args[1].sval, args[2].sval);
 }
 
 static void sqlexec_initCallFunc(const iocshArgBuf *args)
 {
-    sqlexec(args[0].sval);
+    sqlexec(args[0].sval, args[1].ival);
+}
+
+static void pvdumpStats_initCallFunc(const iocshArgBuf *args)
+{
+    PvdumpStats::instance().report(stdout, args[0].ival);
+    if (args[1].ival != 0)
+    {
+        PvdumpStats::instance().reset();
+    }
+}
+
+static void pvdumpWait_initCallFunc(const iocshArgBuf *args)
+{
+    switch(pvdumpWait(args[0].dval))
+    {
+        case 0:
+            printf("pvdump: finished\n");
+            break;
+        case 1:
+            printf("pvdump: still running after %g seconds\n", args[0].dval);
+            break;
+        default:
+            printf("pvdump: failed\n");
+            break;
+    }
+}
+
+static void pvdumpStatus_initCallFunc(const iocshArgBuf *args)
+{
+    pvdumpRunInfo info;
+    if (pvdumpGetRunInfo(&info) != 0)
+    {
+        printf("pvdump: has not been run\n");
+        return;
+    }
+    printf("pvdump: %s\n", (!info.complete ? "running" : (info.status == 0 ? "finished" : "failed")));
+    printf("    %lu PVs with %lu info fields, wrote %lu PVs, %lu info fields and %lu macros with %lu statements\n",
+           info.npv, info.ninfo, info.npv_written, info.ninfo_written, info.nmacro, info.nstatements);
+    printf("    scan %.3f, setup %.3f, delete %.3f, insert %.3f, iocenv %.3f, write %.3f seconds\n",
+           info.scan_time, info.setup_time, info.delete_time, info.insert_time, info.iocenv_time, info.write_time);
+    if (info.lock_retries > 0)
+    {
+        printf("    %lu chunks retried after a deadlock or lock wait timeout\n", info.lock_retries);
+    }
+    PVCatalogRef pvs = pv_catalog.current();
+    if (pvs.valid())
+    {
+        printf("    catalog of %lu PVs with %lu info fields using %lu bytes\n", static_cast<unsigned long>(pvs->size()),
+               static_cast<unsigned long>(pvs->infoCount()), static_cast<unsigned long>(pvs->memoryUsage()));
+    }
+    else
+    {
+        printf("    no catalog kept, PVs were written in chunks as they were scanned\n");
+    }
+    epicsGuard<epicsMutex> _lock(pv_map_mutex);
+    if (live_active)
+    {
+        printf("    live updates every %g seconds, %lu changed PVs waiting\n", liveInterval(), static_cast<unsigned long>(live_changes.size()));
+    }
 }
 
 extern "C" 
@@ -565,22 +3241,132 @@ static void pvdumpRegister(void)
 {
     iocshRegister(&pvdump_initFuncDef, pvdump_initCallFunc);
     iocshRegister(&sqlexec_initFuncDef, sqlexec_initCallFunc);
+    iocshRegister(&pvdumpStats_initFuncDef, pvdumpStats_initCallFunc);
+    iocshRegister(&pvdumpWait_initFuncDef, pvdumpWait_initCallFunc);
+    iocshRegister(&pvdumpStatus_initFuncDef, pvdumpStatus_initCallFunc);
 }
 
 epicsExportRegistrar(pvdumpRegister);
+epicsExportAddress(int, pvdumpBatchRows);
+epicsExportAddress(int, pvdumpBatchBytes);
 
 // these functions are for external non-IOC programs to add PVs to the database e.g. a c# channel access server
 epicsShareFunc int pvdumpAddPV(const char* pvname, const char* record_type, const char* record_desc)
 {
-    epicsGuard<epicsMutex> _lock(pv_map_mutex);
-    pv_map[pvname] = PVInfo(record_type, record_desc);
+    bool start;
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        pv_map.addPV(pvname, record_type, record_desc);
+        start = logLiveChanges(1, &pvname);
+    }
+    startLiveUpdate(start);
     return 0;
 }
 
 epicsShareFunc int pvdumpAddPVInfo(const char* pvname, const char* info_name, const char* info_value)
+{
+    bool start;
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        pv_map.addInfo(pvname, info_name, info_value);
+        start = logLiveChanges(1, &pvname);
+    }
+    startLiveUpdate(start);
+    return 0;
+}
+
+// batch versions of the above, adding or removing n PVs under a single lock. A server with many PVs should
+// use these, removed PVs are deleted from the database by the next pvdumpWritePVs()
+epicsShareFunc int pvdumpAddPVs(int n, const char* const* pvnames, const char* const* record_types, const char* const* record_descs)
+{
+    if (n < 0 || (n > 0 && pvnames == NULL))
+    {
+        return -1;
+    }
+    bool start;
+    try
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        pv_map.addPVs(n, pvnames, record_types, record_descs);
+        start = logLiveChanges(n, pvnames);
+    }
+    catch(std::exception& e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: pvdumpAddPVs: %s\n", e.what());
+        return -1;
+    }
+    startLiveUpdate(start);
+    return n;
+}
+
+epicsShareFunc int pvdumpAddPVInfos(int n, const char* const* pvnames, const char* const* info_names, const char* const* info_values)
+{
+    if (n < 0 || (n > 0 && (pvnames == NULL || info_names == NULL || info_values == NULL)))
+    {
+        return -1;
+    }
+    bool start;
+    try
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        pv_map.addInfos(n, pvnames, info_names, info_values);
+        start = logLiveChanges(n, pvnames);
+    }
+    catch(std::exception& e)
+    {
+        errlogSevPrintf(errlogMinor, "pvdump: pvdumpAddPVInfos: %s\n", e.what());
+        return -1;
+    }
+    startLiveUpdate(start);
+    return n;
+}
+
+epicsShareFunc int pvdumpRemovePVs(int n, const char* const* pvnames)
+{
+    if (n < 0 || (n > 0 && pvnames == NULL))
+    {
+        return -1;
+    }
+    int nremoved = 0;
+    bool start;
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        // only log names we had, the database rows of any others e.g. records of the IOC are not ours to delete
+        pv_map.finalize();
+        std::vector<const char*> present;
+        for(int i = 0; i < n; ++i)
+        {
+            if (pvnames[i] != NULL && pv_map.find(pvnames[i]) != PVCatalog::npos)
+            {
+                present.push_back(pvnames[i]);
+            }
+        }
+        if (!present.empty())
+        {
+            nremoved = static_cast<int>(pv_map.removePVs(present.size(), &present[0]));
+        }
+        start = logLiveChanges(static_cast<int>(present.size()), (present.empty() ? NULL : &present[0]));
+    }
+    startLiveUpdate(start);
+    return nremoved;
+}
+
+epicsShareFunc int pvdumpSetLiveInterval(double interval)
 {
     epicsGuard<epicsMutex> _lock(pv_map_mutex);
-    pv_map[pvname].info_fields[info_name] = info_value;
+    live_interval = interval;
+    if (liveInterval() <= 0.0)
+    {
+        live_active = false;
+        live_changes.clear();
+    }
+    return 0;
+}
+
+// select "insert" or "bulk" (LOAD DATA LOCAL INFILE) for subsequent pvdumpWritePVs() calls, NULL or "" to use PVDUMP_LOAD
+epicsShareFunc int pvdumpSetLoadMode(const char* mode)
+{
+    load_mode = (mode != NULL ? mode : "");
     return 0;
 }
 
@@ -610,7 +3396,87 @@ epicsShareFunc int pvdumpWritePVs(const char* iocname)
     }    
     ioc_name = getIOCName();
     printf("pvdump: IOC name is \"%s\"\n", ioc_name.c_str());
-    return dumpMysql(pv_map, pid, exepath);
+    const unsigned long seq = startRunInfo();
+    // publish a copy so pvdumpAddPV() can carry on adding to pv_map while it is written
+    PVCatalog pvs;
+    {
+        epicsGuard<epicsMutex> _lock(pv_map_mutex);
+        pv_map.finalize();
+        pvs = pv_map;
+        live_changes.clear(); // all in this write
+        activateLiveUpdates();
+    }
+    pvs.report(stdout);
+    PVCatalogRef snapshot(pvs);
+    pv_catalog.publish(snapshot);
+    return dumpMysql(snapshot, pid, exepath, seq);
+}
+
+epicsShareFunc int pvdumpGetRunInfo(pvdumpRunInfo* info)
+{
+    epicsGuard<epicsMutex> _lock(run_info_mutex);
+    if (!have_run_info)
+    {
+        return -1;
+    }
+    *info = run_info;
+    return 0;
+}
+
+epicsShareFunc int pvdumpWait(double timeout)
+{
+    const epicsTime start = epicsTime::getCurrent();
+    for(;;)
+    {
+        {
+            epicsGuard<epicsMutex> _lock(run_info_mutex);
+            if (!have_run_info)
+            {
+                return -1;
+            }
+            if (run_info.complete)
+            {
+                return (run_info.status == 0 ? 0 : -1);
+            }
+        }
+        // the event is not cleared by a new pvdump so we may wake early, and it only wakes one waiter so do not wait long
+        double wait_time = 1.0;
+        if (timeout > 0.0)
+        {
+            double remaining = timeout - elapsedSince(start);
+            if (remaining <= 0.0)
+            {
+                return 1;
+            }
+            wait_time = std::min(remaining, wait_time);
+        }
+        run_info_event.wait(wait_time);
+    }
+}
+
+epicsShareFunc int pvdumpGetPhaseTimings(pvdumpTiming* timings, int max)
+{
+    return PvdumpStats::instance().getPhases(timings, max);
+}
+
+epicsShareFunc int pvdumpGetStatementTimings(pvdumpTiming* timings, int max)
+{
+    return PvdumpStats::instance().getStatements(timings, max);
+}
+
+epicsShareFunc double pvdumpStatsBucketLimit(int bucket)
+{
+    return PvdumpStats::bucketLimit(bucket);
+}
+
+epicsShareFunc void pvdumpStatsReport(int level)
+{
+    PvdumpStats::instance().report(stdout, level);
+}
+
+epicsShareFunc void pvdumpStatsReset(void)
+{
+    PvdumpStats::instance().reset();
 }
 
 }
@@ -0,0 +1,80 @@
+///
+/// @file pvdump.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// C interface to pvdump for non-IOC programs, test and benchmark programs
+///
+#ifndef PVDUMP_H
+#define PVDUMP_H
+
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// wall clock seconds and counts for the phases of the most recent pvdump
+typedef struct pvdumpRunInfo
+{
+    int complete;               ///< 1 once the background database write has finished, or failed
+    int status;                 ///< 0 on success, -1 if the write failed
+    double scan_time;           ///< dump_pvs() scan of the IOC database, 0 for pvdumpWritePVs()
+    double setup_time;          ///< connect, remove our old iocenv, iocrt and pvs rows, write iocrt
+    double delete_time;         ///< remove vanished PVs and those of the same name from other IOCs
+    double insert_time;         ///< write pvs and pvinfo, or just the changes for an incremental sync
+    double iocenv_time;         ///< write iocenv
+    double write_time;          ///< whole background database write
+    unsigned long npv;          ///< PVs in the catalog
+    unsigned long ninfo;        ///< info fields in the catalog
+    unsigned long npv_written;  ///< PVs written, fewer than npv for an incremental sync
+    unsigned long ninfo_written;
+    unsigned long nmacro;       ///< iocenv rows written
+    unsigned long nstatements;  ///< SQL statements executed by the background write
+    unsigned long lock_retries; ///< chunks retried after a deadlock or lock wait timeout
+} pvdumpRunInfo;
+
+#define PVDUMP_STATS_BUCKETS 17   ///< histogram buckets, see pvdumpStatsBucketLimit()
+#define PVDUMP_STATS_NAME_SIZE 40
+
+/// wall clock timing of a pvdump phase or a type of SQL statement
+typedef struct pvdumpTiming
+{
+    char name[PVDUMP_STATS_NAME_SIZE];  ///< phase name e.g. "cleanup", or statement type e.g. "INSERT pvs"
+    unsigned long count;
+    double last;                        ///< seconds
+    double total;
+    double max;
+    unsigned long hist[PVDUMP_STATS_BUCKETS];
+} pvdumpTiming;
+
+epicsShareFunc int pvdumpAddPV(const char* pvname, const char* record_type, const char* record_desc);
+epicsShareFunc int pvdumpAddPVInfo(const char* pvname, const char* info_name, const char* info_value);
+/// add n PVs, or info fields, under one lock. record_types and record_descs may be NULL. Returns n, or -1 on error
+epicsShareFunc int pvdumpAddPVs(int n, const char* const* pvnames, const char* const* record_types, const char* const* record_descs);
+epicsShareFunc int pvdumpAddPVInfos(int n, const char* const* pvnames, const char* const* info_names, const char* const* info_values);
+/// remove n PVs added above, returns the number that were present
+epicsShareFunc int pvdumpRemovePVs(int n, const char* const* pvnames);
+/// after pvdump or pvdumpWritePVs, write PVs added or removed above once interval seconds have passed since the first
+/// change, so a burst of changes goes in one update. 0 turns this off, negative uses PVDUMP_LIVE_INTERVAL (default 0)
+epicsShareFunc int pvdumpSetLiveInterval(double interval);
+epicsShareFunc int pvdumpSetLoadMode(const char* mode);
+epicsShareFunc int pvdumpWritePVs(const char* iocname);
+/// copy the details of the most recent pvdump, returns -1 if there has not been one
+epicsShareFunc int pvdumpGetRunInfo(pvdumpRunInfo* info);
+/// wait up to timeout seconds, or until finished if timeout <= 0, for the background database write of the most recent
+/// pvdump. Returns 0 if it succeeded, 1 if it is still running and -1 if it failed or there has not been one
+epicsShareFunc int pvdumpWait(double timeout);
+/// copy up to max phase or statement timings, returns the number there are
+epicsShareFunc int pvdumpGetPhaseTimings(pvdumpTiming* timings, int max);
+epicsShareFunc int pvdumpGetStatementTimings(pvdumpTiming* timings, int max);
+/// upper limit in seconds of histogram bucket, 0.0 for the last bucket which has no limit
+epicsShareFunc double pvdumpStatsBucketLimit(int bucket);
+/// print timings to stdout, level 0 phases, 1 adds statements, 2 adds histograms
+epicsShareFunc void pvdumpStatsReport(int level);
+epicsShareFunc void pvdumpStatsReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PVDUMP_H */
@@ -0,0 +1,521 @@
+///
+/// @file pvdump_catalog.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Compact in-memory catalog of the PVs, record types, descriptions and info fields of an IOC
+///
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <epicsAtomic.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+
+#include "pvdump_catalog.h"
+
+static const size_t MAX_TAIL_SCAN = 64; // unsorted PVs searched linearly by addInfo before we sort instead
+static const size_t COMPACT_MIN_BYTES = 4096; // below this dead storage is not worth copying the catalog to free
+
+struct PVCatalog::EntryLess
+{
+    const std::vector<char>& m_arena;
+    explicit EntryLess(const std::vector<char>& arena) : m_arena(arena) { }
+    bool operator()(const Entry& a, const Entry& b) const
+    {
+        return strcmp(&(m_arena[a.name]), &(m_arena[b.name])) < 0;
+    }
+    bool operator()(const Entry& a, const char* b) const
+    {
+        return strcmp(&(m_arena[a.name]), b) < 0;
+    }
+};
+
+PVCatalog::PVCatalog() : m_nsorted(0), m_last(npos), m_ninfo(0), m_dead_bytes(0), m_dead_info(0)
+{
+}
+
+void PVCatalog::clear()
+{
+    m_arena.clear();
+    m_entries.clear();
+    m_info.clear();
+    m_types.clear();
+    m_info_names.clear();
+    m_nsorted = 0;
+    m_last = npos;
+    m_ninfo = 0;
+    m_dead_bytes = 0;
+    m_dead_info = 0;
+}
+
+void PVCatalog::swap(PVCatalog& other)
+{
+    m_arena.swap(other.m_arena);
+    m_entries.swap(other.m_entries);
+    m_info.swap(other.m_info);
+    m_types.swap(other.m_types);
+    m_info_names.swap(other.m_info_names);
+    std::swap(m_nsorted, other.m_nsorted);
+    std::swap(m_last, other.m_last);
+    std::swap(m_ninfo, other.m_ninfo);
+    std::swap(m_dead_bytes, other.m_dead_bytes);
+    std::swap(m_dead_info, other.m_dead_info);
+}
+
+void PVCatalog::reserve(size_t npv, size_t ninfo, size_t nbytes)
+{
+    m_entries.reserve(npv);
+    m_info.reserve(ninfo);
+    m_arena.reserve(nbytes);
+}
+
+// make room for that many more, doubling capacity if needed so repeated small batches do not copy everything each time
+template <typename T>
+static void growVector(std::vector<T>& v, size_t n)
+{
+    if (v.size() + n > v.capacity())
+    {
+        v.reserve(std::max(v.size() + n, 2 * v.capacity()));
+    }
+}
+
+void PVCatalog::grow(size_t npv, size_t ninfo, size_t nbytes)
+{
+    growVector(m_entries, npv);
+    growVector(m_info, ninfo);
+    growVector(m_arena, nbytes);
+}
+
+static size_t storedLength(const char* s)
+{
+    return (s != NULL ? strlen(s) + 1 : 1);
+}
+
+epicsUInt32 PVCatalog::store(const char* s)
+{
+    if (s == NULL)
+    {
+        s = "";
+    }
+    size_t offset = m_arena.size();
+    if (offset + strlen(s) + 1 > NO_INFO)
+    {
+        throw std::runtime_error("PV catalog is full");
+    }
+    m_arena.insert(m_arena.end(), s, s + strlen(s) + 1);
+    return static_cast<epicsUInt32>(offset);
+}
+
+epicsUInt32 PVCatalog::intern(InternTable& table, const char* s)
+{
+    if (s == NULL)
+    {
+        s = "";
+    }
+    InternTable::const_iterator it = table.find(s);
+    if (it != table.end())
+    {
+        return it->second;
+    }
+    epicsUInt32 offset = store(s);
+    table.insert(std::make_pair(std::string(s), offset));
+    return offset;
+}
+
+void PVCatalog::addPV(const char* name, const char* record_type, const char* record_desc)
+{
+    Entry entry;
+    entry.name = store(name);
+    entry.type = intern(m_types, record_type);
+    entry.desc = store(record_desc);
+    entry.info = NO_INFO;
+    m_entries.push_back(entry);
+    m_last = m_entries.size() - 1;
+}
+
+void PVCatalog::addPVs(size_t n, const char* const* names, const char* const* types, const char* const* descs)
+{
+    size_t nbytes = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        nbytes += storedLength(names[i]) + (descs != NULL ? storedLength(descs[i]) : 1);
+    }
+    grow(n, 0, nbytes); // record types are interned so mostly need no space
+    for(size_t i = 0; i < n; ++i)
+    {
+        addPV(names[i], (types != NULL ? types[i] : ""), (descs != NULL ? descs[i] : ""));
+    }
+}
+
+void PVCatalog::addInfos(size_t n, const char* const* pvnames, const char* const* info_names, const char* const* values)
+{
+    size_t nbytes = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        nbytes += storedLength(values[i]);
+    }
+    grow(0, n, nbytes);
+    for(size_t i = 0; i < n; ++i)
+    {
+        addInfo(pvnames[i], info_names[i], values[i]);
+    }
+}
+
+// like replaced PVs, the strings and info fields of removed PVs are freed when the catalog is next compacted
+size_t PVCatalog::removePVs(size_t n, const char* const* names)
+{
+    finalize();
+    std::vector<bool> removed(m_entries.size(), false);
+    size_t nremoved = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        size_t j = (names[i] != NULL ? find(names[i]) : npos);
+        if (j != npos && !removed[j])
+        {
+            removed[j] = true;
+            ++nremoved;
+            for(epicsUInt32 k = m_entries[j].info; k != NO_INFO; k = m_info[k].next)
+            {
+                --m_ninfo;
+            }
+            discard(m_entries[j]);
+        }
+    }
+    if (nremoved > 0)
+    {
+        size_t nout = 0;
+        for(size_t i = 0; i < m_entries.size(); ++i)
+        {
+            if (!removed[i])
+            {
+                m_entries[nout++] = m_entries[i];
+            }
+        }
+        m_entries.resize(nout);
+        m_nsorted = nout;
+        compactIfWasteful();
+    }
+    return nremoved;
+}
+
+// index of the most recently added PV called name, adding one if there is none
+size_t PVCatalog::findForUpdate(const char* name)
+{
+    if (m_last != npos && strcmp(str(m_entries[m_last].name), name) == 0)
+    {
+        return m_last;
+    }
+    if (m_entries.size() - m_nsorted > MAX_TAIL_SCAN)
+    {
+        finalize();
+    }
+    for(size_t i = m_entries.size(); i > m_nsorted; --i)
+    {
+        if (strcmp(str(m_entries[i - 1].name), name) == 0)
+        {
+            return i - 1;
+        }
+    }
+    std::vector<Entry>::iterator it = std::lower_bound(m_entries.begin(), m_entries.begin() + m_nsorted, name, EntryLess(m_arena));
+    if (it != m_entries.begin() + m_nsorted && strcmp(str(it->name), name) == 0)
+    {
+        return it - m_entries.begin();
+    }
+    addPV(name, "", "");
+    return m_last;
+}
+
+// add or replace an info field of PV i, keeping the list in name order
+void PVCatalog::setInfo(size_t i, const char* info_name, const char* info_value)
+{
+    epicsUInt32* link = &(m_entries[i].info);
+    while(*link != NO_INFO)
+    {
+        int cmp = strcmp(str(m_info[*link].name), info_name);
+        if (cmp == 0)
+        {
+            m_dead_bytes += strlen(str(m_info[*link].value)) + 1;
+            m_info[*link].value = store(info_value);
+            return;
+        }
+        if (cmp > 0)
+        {
+            break;
+        }
+        link = &(m_info[*link].next);
+    }
+    Info info;
+    info.name = intern(m_info_names, info_name);
+    info.value = store(info_value);
+    info.next = *link;
+    if (m_info.size() >= NO_INFO)
+    {
+        throw std::runtime_error("PV catalog is full");
+    }
+    m_info.push_back(info); // may reallocate, so link is not used after this
+    epicsUInt32 k = static_cast<epicsUInt32>(m_info.size() - 1);
+    if (m_entries[i].info == info.next)
+    {
+        m_entries[i].info = k;
+    }
+    else
+    {
+        epicsUInt32 prev = m_entries[i].info;
+        while(m_info[prev].next != info.next)
+        {
+            prev = m_info[prev].next;
+        }
+        m_info[prev].next = k;
+    }
+    ++m_ninfo;
+}
+
+void PVCatalog::addInfo(const char* pvname, const char* info_name, const char* info_value)
+{
+    setInfo(findForUpdate(pvname), info_name, info_value);
+}
+
+void PVCatalog::addFrom(const PVCatalog& other, size_t i)
+{
+    addPV(other.name(i), other.recordType(i), other.recordDesc(i));
+    size_t j = m_last;
+    for(epicsUInt32 k = other.firstInfo(i); k != NO_INFO; k = other.nextInfo(k))
+    {
+        setInfo(j, other.infoName(k), other.infoValue(k));
+    }
+}
+
+void PVCatalog::append(const PVCatalog& other)
+{
+    reserve(m_entries.size() + other.m_entries.size(), m_info.size() + other.m_info.size(), m_arena.size() + other.m_arena.size());
+    for(size_t i = 0; i < other.size(); ++i)
+    {
+        addFrom(other, i);
+    }
+}
+
+void PVCatalog::finalize()
+{
+    if (finalized())
+    {
+        return;
+    }
+    // stable sort and merge keep PVs of the same name in the order added, so the last one is the one we keep
+    EntryLess less(m_arena);
+    std::stable_sort(m_entries.begin() + m_nsorted, m_entries.end(), less);
+    std::inplace_merge(m_entries.begin(), m_entries.begin() + m_nsorted, m_entries.end(), less);
+    size_t nout = 0;
+    bool dropped = false;
+    for(size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (i + 1 < m_entries.size() && !less(m_entries[i], m_entries[i + 1]))
+        {
+            dropped = true; // replaced by a later PV of the same name
+            discard(m_entries[i]);
+            continue;
+        }
+        m_entries[nout++] = m_entries[i];
+    }
+    m_entries.resize(nout);
+    m_nsorted = nout;
+    m_last = npos;
+    if (dropped)
+    {
+        m_ninfo = 0;
+        for(size_t i = 0; i < m_entries.size(); ++i)
+        {
+            for(epicsUInt32 k = m_entries[i].info; k != NO_INFO; k = m_info[k].next)
+            {
+                ++m_ninfo;
+            }
+        }
+    }
+    compactIfWasteful();
+}
+
+// count the strings and info fields of a replaced or removed PV as dead, interned names are shared so stay live
+void PVCatalog::discard(const Entry& entry)
+{
+    m_dead_bytes += strlen(str(entry.name)) + strlen(str(entry.desc)) + 2;
+    for(epicsUInt32 k = entry.info; k != NO_INFO; k = m_info[k].next)
+    {
+        m_dead_bytes += strlen(str(m_info[k].value)) + 1;
+        ++m_dead_info;
+    }
+}
+
+// copy the live PVs to a new catalog once more storage is dead than live, a finalized catalog is already in order
+// so this is linear. Record type and info names no longer used are dropped from the intern tables too.
+void PVCatalog::compactIfWasteful()
+{
+    const size_t dead = m_dead_bytes + m_dead_info * sizeof(Info);
+    const size_t live = (m_arena.size() - m_dead_bytes) + (m_info.size() - m_dead_info) * sizeof(Info);
+    if (dead < COMPACT_MIN_BYTES || dead <= live)
+    {
+        return;
+    }
+    PVCatalog compacted;
+    compacted.reserve(m_entries.size(), m_info.size() - m_dead_info, m_arena.size() - m_dead_bytes);
+    for(size_t i = 0; i < m_entries.size(); ++i)
+    {
+        compacted.addFrom(*this, i);
+    }
+    compacted.m_nsorted = compacted.m_entries.size();
+    compacted.m_last = npos;
+    swap(compacted);
+}
+
+size_t PVCatalog::find(const char* name) const
+{
+    std::vector<Entry>::const_iterator end = m_entries.begin() + m_nsorted;
+    std::vector<Entry>::const_iterator it = std::lower_bound(m_entries.begin(), end, name, EntryLess(m_arena));
+    if (it != end && strcmp(str(it->name), name) == 0)
+    {
+        return it - m_entries.begin();
+    }
+    return npos;
+}
+
+const char* PVCatalog::findInfo(size_t i, const char* info_name) const
+{
+    for(epicsUInt32 k = m_entries[i].info; k != NO_INFO; k = m_info[k].next)
+    {
+        int cmp = strcmp(str(m_info[k].name), info_name);
+        if (cmp == 0)
+        {
+            return str(m_info[k].value);
+        }
+        if (cmp > 0)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// approximate cost of a std::map node holding a std::string key, on top of the value type
+static const size_t MAP_NODE_BYTES = 32 + sizeof(std::string);
+static const size_t HEAP_OVERHEAD = 16; // per allocation
+static const size_t SSO_LENGTH = 15; // strings up to this length need no heap allocation on common implementations
+
+static size_t stringHeapBytes(const char* s)
+{
+    size_t len = strlen(s);
+    return (len > SSO_LENGTH ? len + 1 + HEAP_OVERHEAD : 0);
+}
+
+size_t PVCatalog::memoryUsage() const
+{
+    size_t bytes = m_arena.capacity() + m_entries.capacity() * sizeof(Entry) + m_info.capacity() * sizeof(Info);
+    const InternTable* tables[2] = { &m_types, &m_info_names };
+    for(int t = 0; t < 2; ++t)
+    {
+        for(InternTable::const_iterator it = tables[t]->begin(); it != tables[t]->end(); ++it)
+        {
+            bytes += MAP_NODE_BYTES + sizeof(epicsUInt32) + HEAP_OVERHEAD + stringHeapBytes(it->first.c_str());
+        }
+    }
+    return bytes;
+}
+
+size_t PVCatalog::mapEquivalentUsage() const
+{
+    const size_t pvinfo_bytes = 2 * sizeof(std::string) + sizeof(std::map<std::string,std::string>);
+    size_t bytes = 0;
+    for(size_t i = 0; i < m_entries.size(); ++i)
+    {
+        bytes += MAP_NODE_BYTES + pvinfo_bytes + HEAP_OVERHEAD + stringHeapBytes(name(i)) + stringHeapBytes(recordType(i)) + stringHeapBytes(recordDesc(i));
+        for(epicsUInt32 k = m_entries[i].info; k != NO_INFO; k = m_info[k].next)
+        {
+            bytes += MAP_NODE_BYTES + sizeof(std::string) + HEAP_OVERHEAD + stringHeapBytes(infoName(k)) + stringHeapBytes(infoValue(k));
+        }
+    }
+    return bytes;
+}
+
+void PVCatalog::report(FILE* fp) const
+{
+    fprintf(fp, "pvdump: catalog of %lu PVs with %lu info entries (%lu record types, %lu info names) uses %lu bytes\n",
+        static_cast<unsigned long>(size()), static_cast<unsigned long>(infoCount()), static_cast<unsigned long>(m_types.size()),
+        static_cast<unsigned long>(m_info_names.size()), static_cast<unsigned long>(memoryUsage()));
+    fprintf(fp, "pvdump: string arena %lu bytes, PV entries %lu bytes, info entries %lu bytes\n",
+        static_cast<unsigned long>(m_arena.capacity()), static_cast<unsigned long>(m_entries.capacity() * sizeof(Entry)),
+        static_cast<unsigned long>(m_info.capacity() * sizeof(Info)));
+    if (finalized())
+    {
+        fprintf(fp, "pvdump: estimated %lu bytes as std::map<std::string,PVInfo>\n", static_cast<unsigned long>(mapEquivalentUsage()));
+    }
+}
+
+PVCatalogRef::PVCatalogRef(PVCatalog& pvs) : m_node(new Node)
+{
+    if (!pvs.finalized())
+    {
+        delete m_node;
+        throw std::logic_error("PVCatalogRef: catalog must be finalized");
+    }
+    m_node->pvs.swap(pvs);
+    m_node->refs = 1;
+}
+
+PVCatalogRef::PVCatalogRef(const PVCatalogRef& other) : m_node(other.m_node)
+{
+    if (m_node != NULL)
+    {
+        epicsAtomicIncrIntT(&(m_node->refs));
+    }
+}
+
+PVCatalogRef& PVCatalogRef::operator=(const PVCatalogRef& other)
+{
+    PVCatalogRef tmp(other);
+    swap(tmp);
+    return *this;
+}
+
+PVCatalogRef::~PVCatalogRef()
+{
+    release();
+}
+
+void PVCatalogRef::swap(PVCatalogRef& other)
+{
+    std::swap(m_node, other.m_node);
+}
+
+void PVCatalogRef::release()
+{
+    if (m_node != NULL && epicsAtomicDecrIntT(&(m_node->refs)) == 0)
+    {
+        delete m_node;
+    }
+    m_node = NULL;
+}
+
+PVCatalogPublisher::PVCatalogPublisher()
+{
+    PVCatalog empty;
+    m_current = PVCatalogRef(empty);
+}
+
+PVCatalogRef PVCatalogPublisher::current() const
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    return m_current;
+}
+
+void PVCatalogPublisher::publish(const PVCatalogRef& pvs)
+{
+    PVCatalogRef old(pvs);
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        m_current.swap(old);
+    }
+    // the previous version, if this was its last reference, is deleted here outside the lock
+}
@@ -0,0 +1,161 @@
+///
+/// @file pvdump_catalog.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Compact in-memory catalog of the PVs, record types, descriptions and info fields of an IOC
+///
+#ifndef PVDUMP_CATALOG_H
+#define PVDUMP_CATALOG_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+/// All strings are stored NUL terminated in a single arena and referred to by offset, record type and
+/// info field names are interned so each distinct name is stored once. PVs are held in a flat vector
+/// sorted by name, additions go on the end and are merged in by finalize(). Info fields of a PV
+/// are a linked list, kept in name order, in a second flat vector.
+///
+/// Strings and info fields of replaced or removed PVs are left in place, and the storage is compacted once
+/// more of it is dead than live, so a catalog that is never cleared does not keep growing.
+///
+/// The const accessors require a finalized catalog, and returned pointers are only valid until the
+/// catalog is next modified.
+class PVCatalog
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+    static const epicsUInt32 NO_INFO = 0xffffffff;
+
+    PVCatalog();
+    void clear();
+    void reserve(size_t npv, size_t ninfo, size_t nbytes);
+    void swap(PVCatalog& other);
+
+    /// add a PV, replacing any existing PV of the same name along with its info fields
+    void addPV(const char* name, const char* record_type, const char* record_desc);
+    /// add or replace an info field, the PV is created with an empty record type and description if needed
+    void addInfo(const char* pvname, const char* info_name, const char* info_value);
+    /// add n PVs in one go, growing storage once for the batch. types and descs may be NULL for empty strings
+    void addPVs(size_t n, const char* const* names, const char* const* types, const char* const* descs);
+    /// add or replace n info fields, as addInfo()
+    void addInfos(size_t n, const char* const* pvnames, const char* const* info_names, const char* const* values);
+    /// remove the named PVs and their info fields, returns the number there were. This finalizes the catalog
+    size_t removePVs(size_t n, const char* const* names);
+    /// add PV i of other, with its info fields
+    void addFrom(const PVCatalog& other, size_t i);
+    /// add all of a finalized catalog, PVs in other replace ours of the same name
+    void append(const PVCatalog& other);
+    /// sort by name and drop replaced PVs, needed before using the const accessors below
+    void finalize();
+    bool finalized() const { return m_nsorted == m_entries.size(); }
+
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    size_t infoCount() const { return m_ninfo; }
+    /// index of PV name or npos
+    size_t find(const char* name) const;
+    const char* name(size_t i) const { return str(m_entries[i].name); }
+    const char* recordType(size_t i) const { return str(m_entries[i].type); }
+    const char* recordDesc(size_t i) const { return str(m_entries[i].desc); }
+    /// info fields of PV i in name order, NO_INFO at the end
+    epicsUInt32 firstInfo(size_t i) const { return m_entries[i].info; }
+    epicsUInt32 nextInfo(epicsUInt32 k) const { return m_info[k].next; }
+    const char* infoName(epicsUInt32 k) const { return str(m_info[k].name); }
+    const char* infoValue(epicsUInt32 k) const { return str(m_info[k].value); }
+    /// value of info field info_name of PV i, or NULL if it does not have one
+    const char* findInfo(size_t i, const char* info_name) const;
+
+    /// bytes allocated by the catalog
+    size_t memoryUsage() const;
+    /// arena bytes and info fields of replaced or removed PVs, not yet freed by compacting
+    size_t deadBytes() const { return m_dead_bytes; }
+    size_t deadInfoCount() const { return m_dead_info; }
+    /// estimated bytes the same content would need as a std::map<std::string,PVInfo> with a std::map of info fields per PV
+    size_t mapEquivalentUsage() const;
+    void report(FILE* fp) const;
+
+private:
+    struct Entry
+    {
+        epicsUInt32 name;
+        epicsUInt32 type;
+        epicsUInt32 desc;
+        epicsUInt32 info; ///< first info field or NO_INFO
+    };
+    struct Info
+    {
+        epicsUInt32 name;
+        epicsUInt32 value;
+        epicsUInt32 next;
+    };
+    struct EntryLess;
+    typedef std::map<std::string, epicsUInt32> InternTable;
+
+    std::vector<char> m_arena;
+    std::vector<Entry> m_entries; ///< [0, m_nsorted) sorted and unique by name, later entries in the order added
+    std::vector<Info> m_info;
+    InternTable m_types;
+    InternTable m_info_names;
+    size_t m_nsorted;
+    size_t m_last; ///< last PV added, usually the target of the next addInfo
+    size_t m_ninfo; ///< info fields of PVs not since replaced
+    size_t m_dead_bytes; ///< arena bytes no longer referred to
+    size_t m_dead_info; ///< m_info entries no longer referred to
+
+    const char* str(epicsUInt32 offset) const { return &(m_arena[offset]); }
+    epicsUInt32 store(const char* s);
+    epicsUInt32 intern(InternTable& table, const char* s);
+    void grow(size_t npv, size_t ninfo, size_t nbytes);
+    size_t findForUpdate(const char* name);
+    void setInfo(size_t i, const char* info_name, const char* info_value);
+    void discard(const Entry& entry);
+    void compactIfWasteful();
+};
+
+/// A reference counted catalog that is never modified once created. Copying a reference does not copy the
+/// catalog, and it is deleted with its last reference, so a holder can read it without any lock.
+class PVCatalogRef
+{
+public:
+    PVCatalogRef() : m_node(NULL) { }
+    /// takes the contents of pvs, which must be finalized, leaving it empty
+    explicit PVCatalogRef(PVCatalog& pvs);
+    PVCatalogRef(const PVCatalogRef& other);
+    PVCatalogRef& operator=(const PVCatalogRef& other);
+    ~PVCatalogRef();
+    void swap(PVCatalogRef& other);
+    bool valid() const { return m_node != NULL; }
+    const PVCatalog& operator*() const { return m_node->pvs; }
+    const PVCatalog* operator->() const { return &(m_node->pvs); }
+
+private:
+    struct Node
+    {
+        PVCatalog pvs;
+        int refs;
+    };
+    Node* m_node;
+    void release();
+};
+
+/// The current version of a catalog. Writers build a new catalog and publish() it, readers take a reference
+/// to the current version with current(); the lock is only held while a reference is copied or replaced.
+class PVCatalogPublisher
+{
+public:
+    PVCatalogPublisher();
+    /// initially an empty catalog, not valid() if one that is not valid() was published
+    PVCatalogRef current() const;
+    void publish(const PVCatalogRef& pvs);
+
+private:
+    mutable epicsMutex m_lock;
+    PVCatalogRef m_current;
+};
+
+#endif /* PVDUMP_CATALOG_H */
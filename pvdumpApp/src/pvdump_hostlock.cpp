@@ -0,0 +1,135 @@
+///
+/// @file pvdump_hostlock.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Lock files limiting how many IOCs on a machine write to the database at once
+///
+/// POSIX record locks belong to the process, so only one thread of an IOC should hold a slot,
+/// which is true of the pvdump writer thread
+///
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include "pvdump_hostlock.h"
+
+static std::string slotFileName(const std::string& file_prefix, int slot)
+{
+    std::ostringstream name;
+    name << file_prefix << slot << ".lock";
+    return name.str();
+}
+
+#ifdef _WIN32
+
+PvdumpHostSlot::PvdumpHostSlot() : m_slot(-1), m_handle(INVALID_HANDLE_VALUE)
+{
+}
+
+bool PvdumpHostSlot::tryAcquire(const std::string& file_prefix, int nslots)
+{
+    release();
+    for(int i = 0; i < nslots; ++i)
+    {
+        std::string file_name = slotFileName(file_prefix, i);
+        HANDLE h = CreateFile(file_name.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE)
+        {
+            std::ostringstream msg;
+            msg << "cannot open lock file \"" << file_name << "\": error " << GetLastError();
+            throw std::runtime_error(msg.str());
+        }
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        if (LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped))
+        {
+            m_handle = h;
+            m_slot = i;
+            return true;
+        }
+        DWORD error = GetLastError();
+        CloseHandle(h);
+        if (error != ERROR_LOCK_VIOLATION && error != ERROR_IO_PENDING)
+        {
+            std::ostringstream msg;
+            msg << "cannot lock file \"" << file_name << "\": error " << error;
+            throw std::runtime_error(msg.str());
+        }
+    }
+    return false;
+}
+
+void PvdumpHostSlot::release()
+{
+    if (m_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_handle); // also unlocks
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+    m_slot = -1;
+}
+
+#else
+
+PvdumpHostSlot::PvdumpHostSlot() : m_slot(-1), m_fd(-1)
+{
+}
+
+bool PvdumpHostSlot::tryAcquire(const std::string& file_prefix, int nslots)
+{
+    release();
+    for(int i = 0; i < nslots; ++i)
+    {
+        std::string file_name = slotFileName(file_prefix, i);
+        int fd = open(file_name.c_str(), O_RDWR | O_CREAT, 0666);
+        if (fd < 0)
+        {
+            throw std::runtime_error("cannot open lock file \"" + file_name + "\": " + strerror(errno));
+        }
+        struct flock fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        fl.l_start = 0;
+        fl.l_len = 0; // whole file
+        if (fcntl(fd, F_SETLK, &fl) == 0)
+        {
+            m_fd = fd;
+            m_slot = i;
+            return true;
+        }
+        int error = errno;
+        close(fd);
+        if (error != EACCES && error != EAGAIN)
+        {
+            throw std::runtime_error("cannot lock file \"" + file_name + "\": " + strerror(error));
+        }
+    }
+    return false;
+}
+
+void PvdumpHostSlot::release()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd); // also unlocks
+        m_fd = -1;
+    }
+    m_slot = -1;
+}
+
+#endif /* _WIN32 */
+
+PvdumpHostSlot::~PvdumpHostSlot()
+{
+    release();
+}
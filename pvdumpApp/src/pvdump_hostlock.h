@@ -0,0 +1,38 @@
+///
+/// @file pvdump_hostlock.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Lock files limiting how many IOCs on a machine write to the database at once
+///
+#ifndef PVDUMP_HOSTLOCK_H
+#define PVDUMP_HOSTLOCK_H
+
+#include <string>
+
+/// One of a fixed number of slots, each a lock file shared by all IOCs on the machine. The operating
+/// system drops the lock if the IOC exits or crashes, so a slot is never left taken.
+class PvdumpHostSlot
+{
+public:
+    PvdumpHostSlot();
+    ~PvdumpHostSlot();
+    /// try to lock one of the files file_prefix + "0.lock" to file_prefix + (nslots-1) + ".lock" without waiting,
+    /// returns true if we now hold one. Errors other than the file being locked throw std::runtime_error
+    bool tryAcquire(const std::string& file_prefix, int nslots);
+    void release();
+    bool held() const { return m_slot >= 0; }
+    int slot() const { return m_slot; }
+
+private:
+    int m_slot;
+#ifdef _WIN32
+    void* m_handle;
+#else
+    int m_fd;
+#endif /* _WIN32 */
+
+    PvdumpHostSlot(const PvdumpHostSlot&);
+    PvdumpHostSlot& operator=(const PvdumpHostSlot&);
+};
+
+#endif /* PVDUMP_HOSTLOCK_H */
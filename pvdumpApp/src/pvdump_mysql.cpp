@@ -21,6 +21,8 @@
 #include <time.h>
 #include <sstream>
 #include <fstream>
+#include <vector>
+#include <memory>
 
 #include "pvdump_mysql.h"
 
@@ -31,56 +33,138 @@
 #include <unistd.h>
 #endif
 
-static SqlDriver* mysql_driver = NULL;
+/// handles kept per connection for reuse by prepareStatement()
+static const size_t MAX_IDLE_STATEMENTS = 64;
 
-const char* SQLException::what()
+SQLException::SQLException(const std::string& message, int code, const std::string& state) : std::runtime_error(message), m_code(code), m_state(state)
 {
-    return "";
 }
 
-const char* SQLException::getSQLStateCStr()
+const char* SQLException::getSQLStateCStr() const
 {
-    return "";
+    return m_state.c_str();
 }
 
-int SQLException::getErrorCode()
+int SQLException::getErrorCode() const
 {
-    return 0;
+    return m_code;
 }
 
-SqlPreparedStatement::SqlPreparedStatement(SQL_CONNECTION conn, const std::string& comm)
+/// throw an SQLException for the call that has just failed on this thread
+static void throwLastError(const std::string& message)
 {
-    m_pstatement = pvdump_mysql_prepareStatement(conn, comm.c_str());
-	if (m_pstatement == nullptr) {
-		throw std::runtime_error("PvdumpMysql: cannot create prepared statment");
+    char error[512], state[8];
+    int code = pvdump_mysql_last_error(error, sizeof(error), state, sizeof(state));
+    if (error[0] == '\0')
+    {
+        throw SQLException(message, code, state);
+    }
+    throw SQLException(message + ": " + error, code, state);
+}
+
+SqlResultSet::SqlResultSet(SQL_RESULTSET rs) : m_resultset(rs)
+{
+	if (m_resultset == nullptr) {
+		throwLastError("PvdumpMysql: query failed");
+	}
+}
+
+SqlResultSet::~SqlResultSet()
+{
+    pvdump_mysql_free_rs(m_resultset);
+}
+
+bool SqlResultSet::next()
+{
+    int ret = pvdump_mysql_rs_next(m_resultset);
+	if (ret < 0) {
+		throwLastError("PvdumpMysql: cannot fetch row");
+	}
+    return (ret != 0);
+}
+
+std::string SqlResultSet::getString(int idx) const
+{
+    char buffer[256];
+    int len = pvdump_mysql_rs_getString(m_resultset, idx, buffer, sizeof(buffer));
+	if (len < 0) {
+		throwLastError("PvdumpMysql: cannot get column value");
 	}
+    if (len < static_cast<int>(sizeof(buffer)))
+    {
+        return buffer;
+    }
+    std::string value(len + 1, '\0');
+    pvdump_mysql_rs_getString(m_resultset, idx, &(value[0]), len + 1);
+    value.resize(len);
+    return value;
+}
+
+int SqlResultSet::getInt(int idx) const
+{
+    return atoi(getString(idx).c_str());
+}
+
+unsigned long long SqlResultSet::getUInt64(int idx) const
+{
+    return strtoull(getString(idx).c_str(), NULL, 10);
+}
+
+SqlPreparedStatement::SqlPreparedStatement(SqlConnection* conn, const std::string& comm, SQL_PSTATEMENT pst, unsigned generation) :
+    m_connection(conn), m_sql(comm), m_pstatement(pst), m_generation(generation)
+{
 }
 
 SqlPreparedStatement::~SqlPreparedStatement()
 {
-    pvdump_mysql_free_pstmt(m_pstatement);
+    if (m_connection != NULL)
+    {
+        m_connection->releaseStatement(this);
+    }
+    else
+    {
+        pvdump_mysql_free_pstmt(m_pstatement);
+    }
 }
 
 void SqlPreparedStatement::setString(int idx, const std::string& value)
 {
-    pvdump_mysql_ps_setString(m_pstatement, idx, value.c_str());
+	if (pvdump_mysql_ps_setString(m_pstatement, idx, value.c_str()) < 0) {
+		throwLastError("PvdumpMysql: cannot set parameter");
+	}
 }
 
 void SqlPreparedStatement::setInt(int idx, int value)
 { 
-    pvdump_mysql_ps_setInt(m_pstatement, idx, value);
+	if (pvdump_mysql_ps_setInt(m_pstatement, idx, value) < 0) {
+		throwLastError("PvdumpMysql: cannot set parameter");
+	}
 }
 
 void SqlPreparedStatement::executeUpdate()
 {
-    pvdump_mysql_ps_executeUpdate(m_pstatement);    
+	if (pvdump_mysql_ps_executeUpdate(m_pstatement) < 0) {
+		throwLastError("PvdumpMysql: cannot execute prepared statement");
+	}
+}
+
+void SqlPreparedStatement::executeBatch(int nrows, int ncols, const char* const* values)
+{
+	if (pvdump_mysql_ps_executeBatch(m_pstatement, nrows, ncols, values) < 0) {
+		throwLastError("PvdumpMysql: cannot execute prepared statement");
+	}
+}
+
+SqlResultSet* SqlPreparedStatement::executeQuery()
+{
+    return new SqlResultSet(pvdump_mysql_ps_executeQuery(m_pstatement));
 }
 
 SqlStatement::SqlStatement(SQL_CONNECTION conn)
 {
     m_statement = pvdump_mysql_createStatement(conn);
 	if (m_statement == nullptr) {
-		throw std::runtime_error("PvdumpMysql: cannot create statment");
+		throwLastError("PvdumpMysql: cannot create statment");
 	}
 }
 
@@ -91,35 +175,109 @@ SqlStatement::~SqlStatement()
 
 void SqlStatement::execute(const std::string& comm)
 {
-    pvdump_mysql_stmt_execute(m_statement, comm.c_str());
+	if (pvdump_mysql_stmt_execute(m_statement, comm.c_str()) < 0) {
+		throwLastError("PvdumpMysql: cannot execute statement");
+	}
 }
 
-SqlConnection::SqlConnection(SQL_DRIVER driver, const char* mysqlHost, const char* db, const char* pw)
+SqlResultSet* SqlStatement::executeQuery(const std::string& comm)
+{
+    return new SqlResultSet(pvdump_mysql_stmt_executeQuery(m_statement, comm.c_str()));
+}
+
+SqlConnection::SqlConnection(SQL_DRIVER driver, const char* mysqlHost, const char* db, const char* pw) : m_generation(0)
 {
     m_connection = pvdump_mysql_connect(driver, mysqlHost, db, pw);
 	if (m_connection == nullptr) {
-		throw std::runtime_error(std::string("PvdumpMysql: cannot connect to ") + mysqlHost);
+		throwLastError(std::string("PvdumpMysql: cannot connect to ") + mysqlHost);
+	}
+}
+
+static const SqlConnectProperty& getOption(const SqlConnectOptions& options, const char* name)
+{
+    static const SqlConnectProperty none;
+    SqlConnectOptions::const_iterator it = options.find(name);
+    return (it != options.end() ? it->second : none);
+}
+
+SqlConnection::SqlConnection(SQL_DRIVER driver, const SqlConnectOptions& options) : m_generation(0)
+{
+    const std::string& host = getOption(options, "hostName").str();
+    m_connection = pvdump_mysql_connect_opts(driver, host.c_str(), getOption(options, "userName").str().c_str(),
+                                   getOption(options, "password").str().c_str(), getOption(options, "OPT_LOCAL_INFILE").num(),
+                                   getOption(options, "OPT_CONNECT_TIMEOUT").num(), getOption(options, "OPT_READ_TIMEOUT").num(),
+                                   getOption(options, "OPT_WRITE_TIMEOUT").num());
+	if (m_connection == nullptr) {
+		throwLastError(std::string("PvdumpMysql: cannot connect to ") + host);
 	}
 }
 
 SqlConnection::~SqlConnection()
 {
+    // statements still open free their own handles when deleted
+    for(std::set<SqlPreparedStatement*>::iterator it = m_open.begin(); it != m_open.end(); ++it)
+    {
+        (*it)->m_connection = NULL;
+    }
+    clearIdle();
     pvdump_mysql_free_conn(m_connection);
 }
 
+void SqlConnection::clearIdle()
+{
+    for(std::multimap<std::string, SQL_PSTATEMENT>::iterator it = m_idle.begin(); it != m_idle.end(); ++it)
+    {
+        pvdump_mysql_free_pstmt(it->second);
+    }
+    m_idle.clear();
+}
+
+void SqlConnection::releaseStatement(SqlPreparedStatement* pstmt)
+{
+    m_open.erase(pstmt);
+    if (pstmt->m_generation == m_generation && m_idle.size() < MAX_IDLE_STATEMENTS)
+    {
+        m_idle.insert(std::make_pair(pstmt->m_sql, pstmt->m_pstatement));
+    }
+    else
+    {
+        pvdump_mysql_free_pstmt(pstmt->m_pstatement);
+    }
+}
+
 void SqlConnection::setAutoCommit(int val)
 {
-    pvdump_mysql_conn_setAutoCommit(m_connection, val);
+	if (pvdump_mysql_conn_setAutoCommit(m_connection, val) < 0) {
+		throwLastError("PvdumpMysql: cannot set autocommit");
+	}
 }
 
 void SqlConnection::setSchema(const char* schema)
 {
-    pvdump_mysql_conn_setSchema(m_connection, schema);
+	if (pvdump_mysql_conn_setSchema(m_connection, schema) < 0) {
+		throwLastError(std::string("PvdumpMysql: cannot set schema ") + schema);
+	}
 }
 
 SqlPreparedStatement* SqlConnection::prepareStatement(const std::string& stmt)
 {
-    return new SqlPreparedStatement(m_connection, stmt);
+    SQL_PSTATEMENT pst;
+    std::multimap<std::string, SQL_PSTATEMENT>::iterator it = m_idle.find(stmt);
+    if (it != m_idle.end())
+    {
+        pst = it->second;
+        m_idle.erase(it);
+    }
+    else
+    {
+        pst = pvdump_mysql_prepareStatement(m_connection, stmt.c_str());
+        if (pst == nullptr) {
+            throwLastError("PvdumpMysql: cannot create prepared statment");
+        }
+    }
+    std::auto_ptr<SqlPreparedStatement> pstmt(new SqlPreparedStatement(this, stmt, pst, m_generation));
+    m_open.insert(pstmt.get());
+    return pstmt.release();
 }
 
 SqlStatement* SqlConnection::createStatement()
@@ -129,7 +287,28 @@ SqlStatement* SqlConnection::createStatement()
 
 void SqlConnection::commit()
 {
-    pvdump_mysql_conn_commit(m_connection);
+	if (pvdump_mysql_conn_commit(m_connection) < 0) {
+		throwLastError("PvdumpMysql: commit failed");
+	}
+}
+
+void SqlConnection::rollback()
+{
+	if (pvdump_mysql_conn_rollback(m_connection) < 0) {
+		throwLastError("PvdumpMysql: rollback failed");
+	}
+}
+
+bool SqlConnection::isValid()
+{
+    return (pvdump_mysql_conn_isValid(m_connection) == 1);
+}
+
+bool SqlConnection::reconnect()
+{
+    clearIdle();
+    ++m_generation;
+    return (pvdump_mysql_conn_reconnect(m_connection) == 0);
 }
 
 SqlDriver* SqlDriver::get_driver_instance()
@@ -145,7 +324,7 @@ SqlDriver::SqlDriver()
 {
     m_driver = pvdump_mysql_get_driver_instance();
 	if (m_driver == nullptr) {
-		throw std::runtime_error("PvdumpMysql: cannot create driver");
+		throwLastError("PvdumpMysql: cannot create driver");
 	}
 }
 
@@ -154,4 +333,9 @@ SqlConnection* SqlDriver::connect(const char* mysqlHost, const char* db, const c
     return new SqlConnection(m_driver, mysqlHost, db, pw);
 }
 
+SqlConnection* SqlDriver::connect(const SqlConnectOptions& options)
+{
+    return new SqlConnection(m_driver, options);
+}
+
 SqlDriver* SqlDriver::g_instance = nullptr;
@@ -1,23 +1,78 @@
 
+#ifndef PVDUMP_MYSQL_H
+#define PVDUMP_MYSQL_H
+
+#include <string>
+#include <map>
+#include <set>
+#include <stdexcept>
+
 #include "pvdump_mysql_int.h"
 
-class SQLException
+/// thrown when a call through the pvdump_mysql interface fails, with the MySQL error code and SQL state
+/// from pvdump_mysql_last_error(). These are 0 and "" if the failure did not come from the server
+class SQLException : public std::runtime_error
+{
+    int m_code;
+    std::string m_state;
+    public:
+    explicit SQLException(const std::string& message, int code = 0, const std::string& state = "");
+    ~SQLException() throw() { }
+    int getErrorCode() const;
+    const char* getSQLStateCStr() const;
+};
+
+class SqlResultSet
 {
+    SQL_RESULTSET m_resultset;
     public:
-    const char* what();
-    int getErrorCode();
-    const char* getSQLStateCStr();
+    explicit SqlResultSet(SQL_RESULTSET rs);
+    ~SqlResultSet();
+    bool next();
+    std::string getString(int idx) const;
+    int getInt(int idx) const;
+    unsigned long long getUInt64(int idx) const;
 };
 
+/// value in a SqlConnectOptions map, only the types used by pvdump are supported
+class SqlConnectProperty
+{
+    std::string m_str;
+    int m_int;
+    public:
+    SqlConnectProperty() : m_int(0) { }
+    SqlConnectProperty(const std::string& value) : m_str(value), m_int(0) { }
+    SqlConnectProperty(const char* value) : m_str(value), m_int(0) { }
+    SqlConnectProperty(int value) : m_int(value) { }
+    const std::string& str() const { return m_str; }
+    int num() const { return m_int; }
+};
+
+/// only hostName, userName, password, OPT_LOCAL_INFILE, OPT_CONNECT_TIMEOUT, OPT_READ_TIMEOUT and OPT_WRITE_TIMEOUT
+/// (seconds, 0 for the client default) are passed on
+typedef std::map<std::string, SqlConnectProperty> SqlConnectOptions;
+
+class SqlConnection;
+
+/// created by SqlConnection::prepareStatement(), deleting it gives the handle back to the connection to reuse
 class SqlPreparedStatement
 {
+    friend class SqlConnection;
+    SqlConnection* m_connection; ///< NULL once the connection has been deleted
+    std::string m_sql;
     SQL_PSTATEMENT m_pstatement;
+    unsigned m_generation; ///< connection generation the handle was prepared in
+    SqlPreparedStatement(SqlConnection* conn, const std::string& comm, SQL_PSTATEMENT pst, unsigned generation);
+    SqlPreparedStatement(const SqlPreparedStatement&);
+    SqlPreparedStatement& operator=(const SqlPreparedStatement&);
     public:
-    SqlPreparedStatement(SQL_CONNECTION conn, const std::string& comm);
     ~SqlPreparedStatement();
     void setString(int idx, const std::string& value);
     void setInt(int idx, int value);
     void executeUpdate();
+    /// execute once per row binding parameters 1 to ncols to values[row * ncols + col], a NULL value binds SQL NULL
+    void executeBatch(int nrows, int ncols, const char* const* values);
+    SqlResultSet* executeQuery();
 };
 
 class SqlStatement
@@ -27,20 +82,34 @@ class SqlStatement
     ~SqlStatement();
     SqlStatement(SQL_CONNECTION conn);
     void execute(const std::string& comm);
+    SqlResultSet* executeQuery(const std::string& comm);
 };
 
 class SqlConnection
 {
+    friend class SqlPreparedStatement;
     private:
     SQL_CONNECTION m_connection;
+    std::multimap<std::string, SQL_PSTATEMENT> m_idle; ///< prepared statements no longer in use, by SQL
+    std::set<SqlPreparedStatement*> m_open; ///< statements still to be deleted
+    unsigned m_generation; ///< incremented on reconnect, as prepared statements do not survive it
+    void releaseStatement(SqlPreparedStatement* pstmt);
+    void clearIdle();
+    SqlConnection(const SqlConnection&);
+    SqlConnection& operator=(const SqlConnection&);
     public:
     SqlConnection(SQL_DRIVER driver, const char* mysqlHost, const char* db, const char* pw);
+    SqlConnection(SQL_DRIVER driver, const SqlConnectOptions& options);
     ~SqlConnection();
     void setAutoCommit(int val);
     void setSchema(const char* schema);
+    /// reuses the handle of a deleted statement with the same SQL if there is one, rather than preparing on the server again
     SqlPreparedStatement* prepareStatement(const std::string& stmt);
     SqlStatement* createStatement();
     void commit();
+    void rollback();
+    bool isValid();
+    bool reconnect();
 };
 
 class SqlDriver
@@ -52,4 +121,26 @@ class SqlDriver
     SqlDriver();
     static SqlDriver* get_driver_instance();
     SqlConnection* connect(const char* mysqlHost, const char* db, const char* pw);
+    SqlConnection* connect(const SqlConnectOptions& options);
 };
+
+#ifdef PVDUMP_MYSQL_INT
+/// names used by the MySQL Connector/C++ API, so pvdump.cpp can be built to go via
+/// the pvdump_mysql interface, and so whichever library implements it, rather than link to MySQL directly
+namespace sql
+{
+    typedef ::SQLException SQLException;
+    typedef ::SqlResultSet ResultSet;
+    typedef ::SqlPreparedStatement PreparedStatement;
+    typedef ::SqlStatement Statement;
+    typedef ::SqlConnection Connection;
+    typedef ::SqlDriver Driver;
+    typedef ::SqlConnectOptions ConnectOptionsMap;
+    namespace mysql
+    {
+        inline Driver* get_driver_instance() { return ::SqlDriver::get_driver_instance(); }
+    }
+}
+#endif /* PVDUMP_MYSQL_INT */
+
+#endif /* PVDUMP_MYSQL_H */
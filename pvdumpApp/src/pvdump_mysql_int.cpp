@@ -22,6 +22,7 @@
 #include <cppconn/resultset.h>
 #include <cppconn/resultset_metadata.h>
 #include <cppconn/statement.h>
+#include <cppconn/datatype.h>
 #include "mysql_driver.h"
 #include "mysql_connection.h"
 
@@ -35,18 +36,46 @@
 #include <unistd.h>
 #endif
 
+#ifdef _WIN32
+#define PVDUMP_THREAD_LOCAL __declspec(thread)
+#else
+#define PVDUMP_THREAD_LOCAL __thread
+#endif
+
+/// the most recent failure on a thread, see pvdump_mysql_last_error()
+struct LastError
+{
+    int code;
+    char sqlstate[8];
+    char message[512];
+};
+
+static PVDUMP_THREAD_LOCAL LastError last_error;
+
+static void setLastError(int code, const char* sqlstate, const char* message)
+{
+    last_error.code = code;
+    strncpy(last_error.sqlstate, sqlstate, sizeof(last_error.sqlstate));
+    last_error.sqlstate[sizeof(last_error.sqlstate) - 1] = '\0';
+    strncpy(last_error.message, message, sizeof(last_error.message));
+    last_error.message[sizeof(last_error.message) - 1] = '\0';
+}
+
 #define TRAP_ERROR \
     catch (const sql::SQLException &e)  \
 	{  \
         fprintf(stderr, "MySQL ERR: %s (MySQL error code: %d, SQLState: %s)\n", e.what(), e.getErrorCode(), e.getSQLStateCStr()); \
+        setLastError(e.getErrorCode(), e.getSQLStateCStr(), e.what()); \
 	} \
 	catch (const std::runtime_error &e) \
 	{ \
         fprintf(stderr, "MySQL ERR: %s\n", e.what()); \
+        setLastError(0, "", e.what()); \
 	} \
     catch(...) \
     { \
         fprintf(stderr, "MySQL ERR: FAILED\n"); \
+        setLastError(0, "", "FAILED"); \
     }
 
 SQL_CONNECTION pvdump_mysql_connect(SQL_DRIVER driver, const char* host, const char* db, const char* pw)
@@ -60,6 +89,38 @@ SQL_CONNECTION pvdump_mysql_connect(SQL_DRIVER driver, const char* host, const c
     return nullptr;
 }
 
+SQL_CONNECTION pvdump_mysql_connect_opts(SQL_DRIVER driver, const char* host, const char* user, const char* pw, int local_infile,
+                                         int connect_timeout, int read_timeout, int write_timeout)
+{
+    try {
+        sql::Driver* mysql_driver = reinterpret_cast<sql::Driver*>(driver);
+        sql::ConnectOptionsMap options;
+        options["hostName"] = std::string(host);
+        options["userName"] = std::string(user);
+        options["password"] = std::string(pw);
+        if (local_infile)
+        {
+            options["OPT_LOCAL_INFILE"] = 1;
+        }
+        if (connect_timeout > 0)
+        {
+            options["OPT_CONNECT_TIMEOUT"] = connect_timeout;
+        }
+        if (read_timeout > 0)
+        {
+            options["OPT_READ_TIMEOUT"] = read_timeout;
+        }
+        if (write_timeout > 0)
+        {
+            options["OPT_WRITE_TIMEOUT"] = write_timeout;
+        }
+        sql::Connection* con = mysql_driver->connect(options);
+        return static_cast<SQL_CONNECTION>(con);
+    }
+    TRAP_ERROR;
+    return nullptr;
+}
+
 SQL_DRIVER pvdump_mysql_get_driver_instance()
 {
     try {
@@ -147,6 +208,37 @@ int pvdump_mysql_conn_commit(SQL_CONNECTION conn)
     return -1;
 }
 
+int pvdump_mysql_conn_rollback(SQL_CONNECTION conn)
+{
+    try {
+        sql::Connection* con = reinterpret_cast<sql::Connection*>(conn);
+	    con->rollback();
+        return 0;
+    }
+    TRAP_ERROR;
+    return -1;
+}
+
+int pvdump_mysql_conn_isValid(SQL_CONNECTION conn)
+{
+    try {
+        sql::Connection* con = reinterpret_cast<sql::Connection*>(conn);
+	    return (con->isValid() ? 1 : 0);
+    }
+    TRAP_ERROR;
+    return 0;
+}
+
+int pvdump_mysql_conn_reconnect(SQL_CONNECTION conn)
+{
+    try {
+        sql::Connection* con = reinterpret_cast<sql::Connection*>(conn);
+	    return (con->reconnect() ? 0 : -1);
+    }
+    TRAP_ERROR;
+    return -1;
+}
+
 SQL_STATEMENT pvdump_mysql_createStatement(SQL_CONNECTION conn)
 {
     try {
@@ -169,6 +261,99 @@ int pvdump_mysql_stmt_execute(SQL_STATEMENT stm, const char* comm)
     return -1;
 }
 
+SQL_RESULTSET pvdump_mysql_stmt_executeQuery(SQL_STATEMENT stm, const char* comm)
+{
+    try {
+        sql::Statement* stmt = reinterpret_cast<sql::Statement*>(stm);
+	    return static_cast<SQL_RESULTSET>(stmt->executeQuery(comm));
+    }
+    TRAP_ERROR;
+    return nullptr;
+}
+
+SQL_RESULTSET pvdump_mysql_ps_executeQuery(SQL_PSTATEMENT pst)
+{
+    try {
+        sql::PreparedStatement* pstmt = reinterpret_cast<sql::PreparedStatement*>(pst);
+	    return static_cast<SQL_RESULTSET>(pstmt->executeQuery());
+    }
+    TRAP_ERROR;
+    return nullptr;
+}
+
+int pvdump_mysql_rs_next(SQL_RESULTSET rs)
+{
+    try {
+        sql::ResultSet* res = reinterpret_cast<sql::ResultSet*>(rs);
+	    return (res->next() ? 1 : 0);
+    }
+    TRAP_ERROR;
+    return -1;
+}
+
+int pvdump_mysql_rs_getString(SQL_RESULTSET rs, int idx, char* buffer, int len)
+{
+    try {
+        sql::ResultSet* res = reinterpret_cast<sql::ResultSet*>(rs);
+        std::string value = res->getString(idx);
+        if (len > 0)
+        {
+            strncpy(buffer, value.c_str(), len);
+            buffer[len - 1] = '\0';
+        }
+	    return static_cast<int>(value.size());
+    }
+    TRAP_ERROR;
+    return -1;
+}
+
+int pvdump_mysql_ps_executeBatch(SQL_PSTATEMENT pst, int nrows, int ncols, const char* const* values)
+{
+    try {
+        sql::PreparedStatement* pstmt = reinterpret_cast<sql::PreparedStatement*>(pst);
+        for(int i = 0; i < nrows; ++i)
+        {
+            for(int j = 0; j < ncols; ++j)
+            {
+                const char* value = values[i * ncols + j];
+                if (value != NULL)
+                {
+                    pstmt->setString(j + 1, value);
+                }
+                else
+                {
+                    pstmt->setNull(j + 1, sql::DataType::VARCHAR);
+                }
+            }
+            pstmt->executeUpdate();
+        }
+        return 0;
+    }
+    TRAP_ERROR;
+    return -1;
+}
+
+int pvdump_mysql_last_error(char* message, int len, char* sqlstate, int state_len)
+{
+    if (message != NULL && len > 0)
+    {
+        strncpy(message, last_error.message, len);
+        message[len - 1] = '\0';
+    }
+    if (sqlstate != NULL && state_len > 0)
+    {
+        strncpy(sqlstate, last_error.sqlstate, state_len);
+        sqlstate[state_len - 1] = '\0';
+    }
+    return last_error.code;
+}
+
+void pvdump_mysql_free_rs(SQL_RESULTSET rs)
+{
+    sql::ResultSet* res = reinterpret_cast<sql::ResultSet*>(rs);
+    delete res;
+}
+
 void pvdump_mysql_free_conn(SQL_CONNECTION conn)
 {
     sql::Connection* con = reinterpret_cast<sql::Connection*>(conn);
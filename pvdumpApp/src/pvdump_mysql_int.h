@@ -7,6 +7,7 @@ typedef void* SQL_DRIVER;
 typedef void* SQL_CONNECTION;
 typedef void* SQL_STATEMENT;
 typedef void* SQL_PSTATEMENT;
+typedef void* SQL_RESULTSET;
 
 #ifdef _WIN32
 #ifdef BUILDING_MQSQL_INT
@@ -33,6 +34,25 @@ PVDUMP_EXPORT void pvdump_mysql_free_conn(SQL_CONNECTION conn);
 PVDUMP_EXPORT void pvdump_mysql_free_stmt(SQL_STATEMENT stm);
 PVDUMP_EXPORT void pvdump_mysql_free_pstmt(SQL_PSTATEMENT pstm);
 
+// added for pvdump.cpp, older consumers do not use these
+// timeouts are in seconds, 0 for the client library default
+PVDUMP_EXPORT SQL_CONNECTION pvdump_mysql_connect_opts(SQL_DRIVER driver, const char* host, const char* user, const char* pw, int local_infile,
+                                                       int connect_timeout, int read_timeout, int write_timeout);
+PVDUMP_EXPORT int pvdump_mysql_conn_rollback(SQL_CONNECTION conn);
+PVDUMP_EXPORT int pvdump_mysql_conn_isValid(SQL_CONNECTION conn);
+PVDUMP_EXPORT int pvdump_mysql_conn_reconnect(SQL_CONNECTION conn);
+PVDUMP_EXPORT SQL_RESULTSET pvdump_mysql_stmt_executeQuery(SQL_STATEMENT stm, const char* comm);
+PVDUMP_EXPORT SQL_RESULTSET pvdump_mysql_ps_executeQuery(SQL_PSTATEMENT pst);
+PVDUMP_EXPORT int pvdump_mysql_rs_next(SQL_RESULTSET rs); // 1 if there is a row, 0 at end, -1 on error
+PVDUMP_EXPORT int pvdump_mysql_rs_getString(SQL_RESULTSET rs, int idx, char* buffer, int len); // full length of value, -1 on error
+PVDUMP_EXPORT void pvdump_mysql_free_rs(SQL_RESULTSET rs);
+// execute pst once per row, first binding its parameters 1 to ncols to the strings values[row * ncols + col],
+// a NULL value binds SQL NULL. Returns 0, or -1 if a row failed in which case later rows are not executed
+PVDUMP_EXPORT int pvdump_mysql_ps_executeBatch(SQL_PSTATEMENT pst, int nrows, int ncols, const char* const* values);
+// MySQL error code of the most recent call on this thread to fail, 0 if it was not a MySQL error or there has not
+// been one. The message and SQL state are copied to message and sqlstate if these are not NULL
+PVDUMP_EXPORT int pvdump_mysql_last_error(char* message, int len, char* sqlstate, int state_len);
+
 };
 
 #endif /* PVDUMP_MYSQLINT_H */
@@ -0,0 +1,775 @@
+///
+/// @file pvdump_mysql_mock.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// In-memory stand in for MySQL behind the pvdump_mysql interface, see pvdump_mysql_mock.h
+///
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <exception>
+#include <stdexcept>
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+
+#define BUILDING_MQSQL_INT
+#include "pvdump_mysql_mock.h"
+
+static const int DEFAULT_LOG_MAX = 100000;
+static const int ER_FILE_NOT_FOUND = 1017;
+static const int ER_NOT_ALLOWED_COMMAND = 1148;
+
+#ifdef _WIN32
+#define PVDUMP_THREAD_LOCAL __declspec(thread)
+#else
+#define PVDUMP_THREAD_LOCAL __thread
+#endif
+
+/// the most recent failure on a thread, see pvdump_mysql_last_error()
+struct LastError
+{
+    int code;
+    char sqlstate[8];
+    char message[512];
+};
+
+static PVDUMP_THREAD_LOCAL LastError last_error;
+
+static void setLastError(int code, const char* sqlstate, const std::string& message)
+{
+    last_error.code = code;
+    strncpy(last_error.sqlstate, sqlstate, sizeof(last_error.sqlstate));
+    last_error.sqlstate[sizeof(last_error.sqlstate) - 1] = '\0';
+    strncpy(last_error.message, message.c_str(), sizeof(last_error.message));
+    last_error.message[sizeof(last_error.message) - 1] = '\0';
+}
+
+struct MockConnection
+{
+    int id;
+    std::string host;
+    bool local_infile;      ///< LOAD DATA LOCAL INFILE allowed, as set when connecting
+    unsigned long row_count; ///< rows loaded by the last LOAD DATA, returned by SELECT ROW_COUNT()
+};
+
+struct MockStatement
+{
+    MockConnection* con;
+};
+
+struct MockPreparedStatement
+{
+    MockConnection* con;
+    std::string sql;
+    std::vector<std::string> params; ///< kept between executions, as with MySQL
+};
+
+struct MockResultSet
+{
+    std::vector< std::vector<std::string> > rows;
+    size_t next; ///< index of the row after the current one
+};
+
+struct MockCall
+{
+    double time; ///< seconds since the mock was started or reset
+    const char* op;
+    int conn;
+    double latency;
+    bool ok;
+    std::string sql;
+    std::vector<std::string> params;
+};
+
+struct MockOpStats
+{
+    unsigned long count;
+    unsigned long failed;
+    unsigned long params;
+    double total;
+    double max;
+    MockOpStats() : count(0), failed(0), params(0), total(0.0), max(0.0) { }
+};
+
+static double getEnvDouble(const char* name, double default_value)
+{
+    const char* str = getenv(name);
+    return (str != NULL && *str != '\0' ? atof(str) : default_value);
+}
+
+static void writeMockLogAtExit();
+
+/// shared state of all mock connections
+class MockServer
+{
+public:
+    epicsMutex m_lock;
+    epicsTime m_start;
+    std::deque<MockCall> m_calls; ///< a deque so pvdump_mock_call_sql() pointers stay valid as calls are added
+    unsigned long m_ncalls;
+    size_t m_log_max;
+    std::map<std::string, MockOpStats> m_stats;
+    std::list< std::pair<std::string, std::string> > m_results; ///< SQL match, rows
+    double m_exec_latency;
+    double m_param_latency;
+    std::string m_fail_match;
+    int m_fail_every;
+    unsigned long m_fail_count; ///< matching executions since failures were last configured
+    int m_fail_code;
+    std::string m_fail_sqlstate;
+    bool m_fail_connect;
+    int m_next_conn;
+    std::string m_log_file;
+
+    MockServer() : m_start(epicsTime::getCurrent()), m_ncalls(0), m_fail_count(0), m_next_conn(1)
+    {
+        m_exec_latency = getEnvDouble("PVDUMP_MOCK_LATENCY", 0.0);
+        m_param_latency = getEnvDouble("PVDUMP_MOCK_PARAM_LATENCY", 0.0);
+        const char* match = getenv("PVDUMP_MOCK_FAIL_MATCH");
+        m_fail_match = (match != NULL ? match : "");
+        m_fail_every = static_cast<int>(getEnvDouble("PVDUMP_MOCK_FAIL_EVERY", 0));
+        m_fail_connect = (getEnvDouble("PVDUMP_MOCK_FAIL_CONNECT", 0) != 0);
+        m_fail_code = static_cast<int>(getEnvDouble("PVDUMP_MOCK_FAIL_CODE", 0));
+        m_fail_sqlstate = (m_fail_code != 0 ? "HY000" : "");
+        m_log_max = static_cast<size_t>(getEnvDouble("PVDUMP_MOCK_LOG_MAX", DEFAULT_LOG_MAX));
+        const char* log_file = getenv("PVDUMP_MOCK_LOG");
+        m_log_file = (log_file != NULL ? log_file : "");
+    }
+
+    // never deleted, so it is still there for connections closed late in process exit. Created
+    // once whichever of the writer, shard and exit threads gets here first
+    static MockServer& instance()
+    {
+        static epicsThreadOnceId once = EPICS_THREAD_ONCE_INIT;
+        epicsThreadOnce(&once, create, NULL);
+        return *g_server;
+    }
+
+private:
+    static MockServer* g_server;
+
+    static void create(void*)
+    {
+        g_server = new MockServer;
+        if (g_server->m_log_file.size() > 0)
+        {
+            atexit(writeMockLogAtExit);
+        }
+    }
+
+public:
+
+    bool willFail(const std::string& sql)
+    {
+        if (m_fail_every <= 0 || (m_fail_match.size() > 0 && sql.find(m_fail_match) == std::string::npos))
+        {
+            return false;
+        }
+        return (++m_fail_count % m_fail_every) == 0;
+    }
+
+    void fillResult(const std::string& sql, MockResultSet* rs)
+    {
+        for(std::list< std::pair<std::string, std::string> >::const_iterator it = m_results.begin(); it != m_results.end(); ++it)
+        {
+            if (sql.find(it->first) == std::string::npos)
+            {
+                continue;
+            }
+            std::istringstream rows(it->second);
+            std::string line;
+            while(std::getline(rows, line))
+            {
+                std::vector<std::string> row;
+                size_t start = 0, tab;
+                while((tab = line.find('\t', start)) != std::string::npos)
+                {
+                    row.push_back(line.substr(start, tab - start));
+                    start = tab + 1;
+                }
+                row.push_back(line.substr(start));
+                rs->rows.push_back(row);
+            }
+            return;
+        }
+    }
+
+    /// simulate a call, sleeping for any injected latency, and record it. Returns false if the call is to fail,
+    /// which it always does with error refuse_code if that is not 0.
+    bool call(const char* op, const MockConnection* con, const std::string& sql, const std::vector<std::string>* params = NULL,
+              bool executes = false, MockResultSet* rs = NULL, int refuse_code = 0)
+    {
+        epicsTime start(epicsTime::getCurrent());
+        double latency = 0.0;
+        bool ok = true;
+        int fail_code = 0;
+        std::string fail_sqlstate;
+        {
+            epicsGuard<epicsMutex> _lock(m_lock);
+            if (executes)
+            {
+                latency = m_exec_latency + (params != NULL ? m_param_latency * params->size() : 0.0);
+                ok = !willFail(sql);
+                fail_code = m_fail_code;
+                fail_sqlstate = m_fail_sqlstate;
+            }
+            if (ok && refuse_code != 0)
+            {
+                ok = false;
+                fail_code = refuse_code;
+                fail_sqlstate = "HY000";
+            }
+            if (ok && rs != NULL)
+            {
+                fillResult(sql, rs);
+            }
+        }
+        if (latency > 0.0)
+        {
+            epicsThreadSleep(latency);
+        }
+        if (!ok)
+        {
+            const char* what = (refuse_code != 0 ? "refused" : "injected failure of");
+            fprintf(stderr, "MySQL ERR: pvdump_mysqlmock %s %s: %.200s\n", what, op, sql.c_str());
+            setLastError(fail_code, fail_sqlstate.c_str(), std::string("pvdump_mysqlmock ") + what + " " + op);
+        }
+        epicsTime now(epicsTime::getCurrent());
+        epicsGuard<epicsMutex> _lock(m_lock);
+        MockOpStats& stats = m_stats[op];
+        ++stats.count;
+        stats.total += now - start;
+        if (now - start > stats.max)
+        {
+            stats.max = now - start;
+        }
+        if (!ok)
+        {
+            ++stats.failed;
+        }
+        if (params != NULL)
+        {
+            stats.params += static_cast<unsigned long>(params->size());
+        }
+        ++m_ncalls;
+        if (m_calls.size() < m_log_max)
+        {
+            MockCall c;
+            c.time = start - m_start;
+            c.op = op;
+            c.conn = (con != NULL ? con->id : 0);
+            c.latency = now - start;
+            c.ok = ok;
+            c.sql = sql;
+            m_calls.push_back(c);
+            if (params != NULL)
+            {
+                m_calls.back().params = *params;
+            }
+        }
+        return ok;
+    }
+};
+
+MockServer* MockServer::g_server = NULL;
+
+static void writeMockLogAtExit()
+{
+    MockServer& server = MockServer::instance();
+    pvdump_mock_write_log(server.m_log_file.c_str());
+}
+
+// tabs and newlines would break up the log lines
+static std::string escapeLog(const std::string& s)
+{
+    std::string res;
+    res.reserve(s.size());
+    for(size_t i = 0; i < s.size(); ++i)
+    {
+        switch(s[i])
+        {
+            case '\t':
+                res += "\\t";
+                break;
+            case '\n':
+                res += "\\n";
+                break;
+            case '\r':
+                res += "\\r";
+                break;
+            case '\\':
+                res += "\\\\";
+                break;
+            default:
+                res += s[i];
+                break;
+        }
+    }
+    return res;
+}
+
+static void setParam(MockPreparedStatement* pstmt, int idx, const std::string& value)
+{
+    if (pstmt->params.size() < static_cast<size_t>(idx))
+    {
+        pstmt->params.resize(idx);
+    }
+    pstmt->params[idx - 1] = value;
+}
+
+SQL_DRIVER pvdump_mysql_get_driver_instance()
+{
+    return static_cast<SQL_DRIVER>(&MockServer::instance());
+}
+
+// credentials and timeouts are not used by the mock
+SQL_CONNECTION pvdump_mysql_connect_opts(SQL_DRIVER driver, const char* host, const char*, const char*, int local_infile, int, int, int)
+{
+    MockServer& server = *reinterpret_cast<MockServer*>(driver);
+    MockConnection* con = new MockConnection;
+    bool fail_connect;
+    {
+        epicsGuard<epicsMutex> _lock(server.m_lock);
+        con->id = server.m_next_conn++;
+        fail_connect = server.m_fail_connect;
+    }
+    con->host = host;
+    con->local_infile = (local_infile != 0);
+    con->row_count = 0;
+    if (!server.call("connect", con, host) || fail_connect)
+    {
+        fprintf(stderr, "MySQL ERR: pvdump_mysqlmock cannot connect to %s\n", host);
+        setLastError(2003, "HY000", std::string("pvdump_mysqlmock cannot connect to ") + host);
+        delete con;
+        return nullptr;
+    }
+    return static_cast<SQL_CONNECTION>(con);
+}
+
+SQL_CONNECTION pvdump_mysql_connect(SQL_DRIVER driver, const char* host, const char* db, const char* pw)
+{
+    return pvdump_mysql_connect_opts(driver, host, db, pw, 0, 0, 0, 0);
+}
+
+int pvdump_mysql_conn_setAutoCommit(SQL_CONNECTION conn, int value)
+{
+    MockConnection* con = reinterpret_cast<MockConnection*>(conn);
+    return (MockServer::instance().call("setAutoCommit", con, (value != 0 ? "1" : "0")) ? 0 : -1);
+}
+
+int pvdump_mysql_conn_setSchema(SQL_CONNECTION conn, const char* schema)
+{
+    MockConnection* con = reinterpret_cast<MockConnection*>(conn);
+    return (MockServer::instance().call("setSchema", con, schema) ? 0 : -1);
+}
+
+int pvdump_mysql_conn_commit(SQL_CONNECTION conn)
+{
+    MockConnection* con = reinterpret_cast<MockConnection*>(conn);
+    return (MockServer::instance().call("commit", con, "COMMIT", NULL, true) ? 0 : -1);
+}
+
+int pvdump_mysql_conn_rollback(SQL_CONNECTION conn)
+{
+    MockConnection* con = reinterpret_cast<MockConnection*>(conn);
+    return (MockServer::instance().call("rollback", con, "ROLLBACK") ? 0 : -1);
+}
+
+int pvdump_mysql_conn_isValid(SQL_CONNECTION)
+{
+    return 1;
+}
+
+int pvdump_mysql_conn_reconnect(SQL_CONNECTION conn)
+{
+    MockConnection* con = reinterpret_cast<MockConnection*>(conn);
+    return (MockServer::instance().call("connect", con, con->host) ? 0 : -1);
+}
+
+SQL_STATEMENT pvdump_mysql_createStatement(SQL_CONNECTION conn)
+{
+    MockStatement* stmt = new MockStatement;
+    stmt->con = reinterpret_cast<MockConnection*>(conn);
+    return static_cast<SQL_STATEMENT>(stmt);
+}
+
+// number of lines in the file of a LOAD DATA LOCAL INFILE statement, -1 if it cannot be read
+static long loadDataLines(const char* comm)
+{
+    static const char prefix[] = "LOAD DATA LOCAL INFILE '";
+    std::string file_name;
+    for(const char* p = comm + sizeof(prefix) - 1; *p != '\0' && *p != '\''; ++p)
+    {
+        if (*p == '\\' && p[1] != '\0')
+        {
+            ++p;
+        }
+        file_name += *p;
+    }
+    FILE* fp = fopen(file_name.c_str(), "rb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    long nlines = 0;
+    int c;
+    while((c = fgetc(fp)) != EOF)
+    {
+        nlines += (c == '\n' ? 1 : 0);
+    }
+    fclose(fp);
+    return nlines;
+}
+
+// as with MySQL LOAD DATA LOCAL INFILE is refused unless local_infile was set when connecting. Every line
+// of the file is taken as loaded
+int pvdump_mysql_stmt_execute(SQL_STATEMENT stm, const char* comm)
+{
+    MockStatement* stmt = reinterpret_cast<MockStatement*>(stm);
+    int refuse_code = 0;
+    long nlines = 0;
+    if (strncmp(comm, "LOAD DATA LOCAL INFILE '", 24) == 0)
+    {
+        nlines = loadDataLines(comm);
+        refuse_code = (!stmt->con->local_infile ? ER_NOT_ALLOWED_COMMAND : (nlines < 0 ? ER_FILE_NOT_FOUND : 0));
+    }
+    if (!MockServer::instance().call("execute", stmt->con, comm, NULL, true, NULL, refuse_code))
+    {
+        return -1;
+    }
+    stmt->con->row_count = static_cast<unsigned long>(nlines);
+    return 0;
+}
+
+SQL_RESULTSET pvdump_mysql_stmt_executeQuery(SQL_STATEMENT stm, const char* comm)
+{
+    MockStatement* stmt = reinterpret_cast<MockStatement*>(stm);
+    MockResultSet* rs = new MockResultSet;
+    rs->next = 0;
+    if (!MockServer::instance().call("executeQuery", stmt->con, comm, NULL, true, rs))
+    {
+        delete rs;
+        return nullptr;
+    }
+    if (rs->rows.empty() && strcmp(comm, "SELECT ROW_COUNT()") == 0)
+    {
+        std::ostringstream count;
+        count << stmt->con->row_count;
+        rs->rows.push_back(std::vector<std::string>(1, count.str()));
+    }
+    return static_cast<SQL_RESULTSET>(rs);
+}
+
+SQL_PSTATEMENT pvdump_mysql_prepareStatement(SQL_CONNECTION conn, const char* comm)
+{
+    MockPreparedStatement* pstmt = new MockPreparedStatement;
+    pstmt->con = reinterpret_cast<MockConnection*>(conn);
+    pstmt->sql = comm;
+    if (!MockServer::instance().call("prepare", pstmt->con, pstmt->sql))
+    {
+        delete pstmt;
+        return nullptr;
+    }
+    return static_cast<SQL_PSTATEMENT>(pstmt);
+}
+
+static void invalidParameterIndex(int idx)
+{
+    fprintf(stderr, "MySQL ERR: pvdump_mysqlmock invalid parameter index %d\n", idx);
+    setLastError(0, "07009", "pvdump_mysqlmock invalid parameter index");
+}
+
+int pvdump_mysql_ps_setString(SQL_PSTATEMENT pst, int idx, const char* value)
+{
+    MockPreparedStatement* pstmt = reinterpret_cast<MockPreparedStatement*>(pst);
+    if (idx < 1)
+    {
+        invalidParameterIndex(idx);
+        return -1;
+    }
+    setParam(pstmt, idx, value);
+    return 0;
+}
+
+int pvdump_mysql_ps_setInt(SQL_PSTATEMENT pst, int idx, int value)
+{
+    MockPreparedStatement* pstmt = reinterpret_cast<MockPreparedStatement*>(pst);
+    if (idx < 1)
+    {
+        invalidParameterIndex(idx);
+        return -1;
+    }
+    char buffer[32];
+    sprintf(buffer, "%d", value);
+    setParam(pstmt, idx, buffer);
+    return 0;
+}
+
+int pvdump_mysql_ps_executeUpdate(SQL_PSTATEMENT pst)
+{
+    MockPreparedStatement* pstmt = reinterpret_cast<MockPreparedStatement*>(pst);
+    return (MockServer::instance().call("executeUpdate", pstmt->con, pstmt->sql, &(pstmt->params), true) ? 0 : -1);
+}
+
+// each row is recorded as a separate execution, as each is a round trip to a real server
+int pvdump_mysql_ps_executeBatch(SQL_PSTATEMENT pst, int nrows, int ncols, const char* const* values)
+{
+    MockPreparedStatement* pstmt = reinterpret_cast<MockPreparedStatement*>(pst);
+    for(int i = 0; i < nrows; ++i)
+    {
+        for(int j = 0; j < ncols; ++j)
+        {
+            const char* value = values[i * ncols + j];
+            setParam(pstmt, j + 1, (value != NULL ? value : "\\N"));
+        }
+        if (!MockServer::instance().call("executeUpdate", pstmt->con, pstmt->sql, &(pstmt->params), true))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+SQL_RESULTSET pvdump_mysql_ps_executeQuery(SQL_PSTATEMENT pst)
+{
+    MockPreparedStatement* pstmt = reinterpret_cast<MockPreparedStatement*>(pst);
+    MockResultSet* rs = new MockResultSet;
+    rs->next = 0;
+    if (!MockServer::instance().call("executeQuery", pstmt->con, pstmt->sql, &(pstmt->params), true, rs))
+    {
+        delete rs;
+        return nullptr;
+    }
+    return static_cast<SQL_RESULTSET>(rs);
+}
+
+int pvdump_mysql_rs_next(SQL_RESULTSET rs)
+{
+    MockResultSet* res = reinterpret_cast<MockResultSet*>(rs);
+    if (res->next >= res->rows.size())
+    {
+        return 0;
+    }
+    ++(res->next);
+    return 1;
+}
+
+int pvdump_mysql_rs_getString(SQL_RESULTSET rs, int idx, char* buffer, int len)
+{
+    MockResultSet* res = reinterpret_cast<MockResultSet*>(rs);
+    if (res->next == 0 || res->next > res->rows.size() || idx < 1 || static_cast<size_t>(idx) > res->rows[res->next - 1].size())
+    {
+        fprintf(stderr, "MySQL ERR: pvdump_mysqlmock no column %d in current row\n", idx);
+        setLastError(0, "07009", "pvdump_mysqlmock no such column in current row");
+        return -1;
+    }
+    const std::string& value = res->rows[res->next - 1][idx - 1];
+    if (len > 0)
+    {
+        strncpy(buffer, value.c_str(), len);
+        buffer[len - 1] = '\0';
+    }
+    return static_cast<int>(value.size());
+}
+
+int pvdump_mysql_last_error(char* message, int len, char* sqlstate, int state_len)
+{
+    if (message != NULL && len > 0)
+    {
+        strncpy(message, last_error.message, len);
+        message[len - 1] = '\0';
+    }
+    if (sqlstate != NULL && state_len > 0)
+    {
+        strncpy(sqlstate, last_error.sqlstate, state_len);
+        sqlstate[state_len - 1] = '\0';
+    }
+    return last_error.code;
+}
+
+void pvdump_mysql_free_rs(SQL_RESULTSET rs)
+{
+    delete reinterpret_cast<MockResultSet*>(rs);
+}
+
+void pvdump_mysql_free_conn(SQL_CONNECTION conn)
+{
+    delete reinterpret_cast<MockConnection*>(conn);
+}
+
+void pvdump_mysql_free_stmt(SQL_STATEMENT stm)
+{
+    delete reinterpret_cast<MockStatement*>(stm);
+}
+
+void pvdump_mysql_free_pstmt(SQL_PSTATEMENT pstm)
+{
+    delete reinterpret_cast<MockPreparedStatement*>(pstm);
+}
+
+void pvdump_mock_reset()
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_calls.clear();
+    server.m_stats.clear();
+    server.m_results.clear();
+    server.m_ncalls = 0;
+    server.m_fail_count = 0;
+    server.m_start = epicsTime::getCurrent();
+}
+
+void pvdump_mock_set_latency(double exec_latency, double param_latency)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_exec_latency = exec_latency;
+    server.m_param_latency = param_latency;
+}
+
+void pvdump_mock_set_failure(const char* match, int every)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_fail_match = (match != NULL ? match : "");
+    server.m_fail_every = every;
+    server.m_fail_count = 0;
+}
+
+void pvdump_mock_set_failure_code(int code, const char* sqlstate)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_fail_code = code;
+    server.m_fail_sqlstate = (sqlstate != NULL ? sqlstate : "");
+}
+
+void pvdump_mock_set_connect_failure(int fail)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_fail_connect = (fail != 0);
+}
+
+void pvdump_mock_set_result(const char* match, const char* rows)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    server.m_results.push_back(std::pair<std::string, std::string>(match, rows));
+}
+
+int pvdump_mock_call_count()
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    return static_cast<int>(server.m_ncalls);
+}
+
+// the logged call i or NULL, called with the server locked
+static const MockCall* loggedCall(const MockServer& server, int i)
+{
+    if (i < 0 || static_cast<size_t>(i) >= server.m_calls.size())
+    {
+        return NULL;
+    }
+    return &(server.m_calls[i]);
+}
+
+const char* pvdump_mock_call_sql(int i)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    return (c != NULL ? c->sql.c_str() : NULL);
+}
+
+const char* pvdump_mock_call_op(int i)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    return (c != NULL ? c->op : NULL);
+}
+
+int pvdump_mock_call_conn(int i)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    return (c != NULL ? c->conn : 0);
+}
+
+int pvdump_mock_call_ok(int i)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    return (c != NULL && c->ok ? 1 : 0);
+}
+
+int pvdump_mock_call_nparams(int i)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    return (c != NULL ? static_cast<int>(c->params.size()) : -1);
+}
+
+const char* pvdump_mock_call_param(int i, int j)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    const MockCall* c = loggedCall(server, i);
+    if (c == NULL || j < 0 || static_cast<size_t>(j) >= c->params.size())
+    {
+        return NULL;
+    }
+    return c->params[j].c_str();
+}
+
+void pvdump_mock_report(FILE* fp)
+{
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    fprintf(fp, "pvdump_mysqlmock: %lu calls, %lu in log\n", server.m_ncalls, static_cast<unsigned long>(server.m_calls.size()));
+    for(std::map<std::string, MockOpStats>::const_iterator it = server.m_stats.begin(); it != server.m_stats.end(); ++it)
+    {
+        const MockOpStats& stats = it->second;
+        fprintf(fp, "pvdump_mysqlmock: %-14s %8lu calls %6lu failed %10lu params %10.3f s total %8.3f ms mean %8.3f ms max\n",
+            it->first.c_str(), stats.count, stats.failed, stats.params, stats.total,
+            (stats.count > 0 ? 1000.0 * stats.total / stats.count : 0.0), 1000.0 * stats.max);
+    }
+}
+
+int pvdump_mock_write_log(const char* filename)
+{
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "pvdump_mysqlmock: cannot write log \"%s\"\n", filename);
+        return -1;
+    }
+    MockServer& server = MockServer::instance();
+    epicsGuard<epicsMutex> _lock(server.m_lock);
+    for(size_t i = 0; i < server.m_calls.size(); ++i)
+    {
+        const MockCall& c = server.m_calls[i];
+        fprintf(fp, "%.6f\t%s\t%d\t%.6f\t%s\t%s", c.time, c.op, c.conn, c.latency, (c.ok ? "ok" : "failed"), escapeLog(c.sql).c_str());
+        for(size_t j = 0; j < c.params.size(); ++j)
+        {
+            fprintf(fp, "\t%s", escapeLog(c.params[j]).c_str());
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    return 0;
+}
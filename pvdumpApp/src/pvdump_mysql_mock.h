@@ -0,0 +1,63 @@
+///
+/// @file pvdump_mysql_mock.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// In-memory stand in for MySQL behind the pvdump_mysql interface, for benchmarking and testing
+/// the pvdump write path without a database server. Link pvdump_mysqlmock instead of pvdump_mysql.
+///
+/// Nothing is stored, every call is recorded with its SQL, bound parameters and latency, queries
+/// return no rows unless a result has been set with pvdump_mock_set_result(). As with MySQL, LOAD DATA
+/// LOCAL INFILE is refused unless local infile was enabled when connecting, otherwise every line of the
+/// file counts as loaded and SELECT ROW_COUNT() returns that number. Latency and failures
+/// can be injected, these are initially set from the environment when the driver is first used:
+///
+///   PVDUMP_MOCK_LATENCY        seconds added to every statement execution and commit
+///   PVDUMP_MOCK_PARAM_LATENCY  seconds added per bound parameter of a prepared statement execution
+///   PVDUMP_MOCK_FAIL_MATCH     only statements whose SQL contains this can fail (default: all)
+///   PVDUMP_MOCK_FAIL_EVERY     every Nth matching statement execution fails (default: 0, never)
+///   PVDUMP_MOCK_FAIL_CODE      MySQL error code of injected failures, e.g. 1213 for a deadlock (default: 0)
+///   PVDUMP_MOCK_FAIL_CONNECT   if non-zero, connecting fails
+///   PVDUMP_MOCK_LOG_MAX        maximum calls kept in the log (default: 100000), later calls are only counted
+///   PVDUMP_MOCK_LOG            if set, the call log is written to this file at process exit
+///
+#ifndef PVDUMP_MYSQL_MOCK_H
+#define PVDUMP_MYSQL_MOCK_H
+
+#include <stdio.h>
+
+#include "pvdump_mysql_int.h"
+
+extern "C" {
+
+/// forget all recorded calls, results and counters, injected latency and failures are kept
+PVDUMP_EXPORT void pvdump_mock_reset();
+PVDUMP_EXPORT void pvdump_mock_set_latency(double exec_latency, double param_latency);
+/// make every Nth execution of a statement whose SQL contains match fail, every of 0 disables
+PVDUMP_EXPORT void pvdump_mock_set_failure(const char* match, int every);
+/// MySQL error code and SQL state that pvdump_mysql_last_error() reports for injected failures
+PVDUMP_EXPORT void pvdump_mock_set_failure_code(int code, const char* sqlstate);
+PVDUMP_EXPORT void pvdump_mock_set_connect_failure(int fail);
+/// rows returned by queries whose SQL contains match, rows separated by newlines and columns by tabs
+PVDUMP_EXPORT void pvdump_mock_set_result(const char* match, const char* rows);
+/// number of calls made, including those no longer in the log
+PVDUMP_EXPORT int pvdump_mock_call_count();
+/// SQL of call i in the log or NULL, the pointer is valid until the next pvdump_mock_reset()
+PVDUMP_EXPORT const char* pvdump_mock_call_sql(int i);
+/// operation of call i in the log, e.g. "executeUpdate", or NULL
+PVDUMP_EXPORT const char* pvdump_mock_call_op(int i);
+/// connection number of call i in the log, 0 if there is no such call
+PVDUMP_EXPORT int pvdump_mock_call_conn(int i);
+/// 1 if call i in the log succeeded, 0 if it failed or there is no such call
+PVDUMP_EXPORT int pvdump_mock_call_ok(int i);
+/// number of parameters bound for call i in the log, -1 if there is no such call
+PVDUMP_EXPORT int pvdump_mock_call_nparams(int i);
+/// parameter j (from 0) bound for call i in the log or NULL, valid until the next pvdump_mock_reset()
+PVDUMP_EXPORT const char* pvdump_mock_call_param(int i, int j);
+/// per operation counts and latencies
+PVDUMP_EXPORT void pvdump_mock_report(FILE* fp);
+/// write the call log as tab separated lines of time, operation, connection, latency, status, SQL and parameters
+PVDUMP_EXPORT int pvdump_mock_write_log(const char* filename);
+
+};
+
+#endif /* PVDUMP_MYSQL_MOCK_H */
@@ -0,0 +1,269 @@
+///
+/// @file pvdump_spool.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Local SQLite spool of pvdump snapshots, written before they are sent to MySQL
+///
+/// The sqlite3 C API is used directly as the easySQLite classes are in namespace sql,
+/// which is also used by MySQL Connector/C++
+///
+#include <string.h>
+#include <string>
+#include <list>
+#include <stdexcept>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+
+#include "sqlite3.h"
+
+#include "pvdump_spool.h"
+
+static const int BUSY_TIMEOUT_MS = 10000; // the file may be in use by another IOC on this machine
+
+static const char* SPOOL_SCHEMA =
+    "CREATE TABLE IF NOT EXISTS snapshots (id INTEGER PRIMARY KEY AUTOINCREMENT, iocname TEXT NOT NULL, pid INTEGER, exe_path TEXT, "
+    "    created TEXT DEFAULT CURRENT_TIMESTAMP);"
+    "CREATE INDEX IF NOT EXISTS snapshots_iocname ON snapshots (iocname);"
+    "CREATE TABLE IF NOT EXISTS pvs (snapshot INTEGER NOT NULL, pvname TEXT, record_type TEXT, record_desc TEXT);"
+    "CREATE INDEX IF NOT EXISTS pvs_snapshot ON pvs (snapshot);"
+    "CREATE TABLE IF NOT EXISTS pvinfo (snapshot INTEGER NOT NULL, pvname TEXT, infoname TEXT, value TEXT);"
+    "CREATE INDEX IF NOT EXISTS pvinfo_snapshot ON pvinfo (snapshot);"
+    "CREATE TABLE IF NOT EXISTS environ (snapshot INTEGER NOT NULL, entry TEXT);"
+    "CREATE INDEX IF NOT EXISTS environ_snapshot ON environ (snapshot);";
+
+/// finalizes a prepared statement when going out of scope
+class SpoolStatement
+{
+    sqlite3_stmt* m_stmt;
+public:
+    explicit SpoolStatement(sqlite3_stmt* stmt) : m_stmt(stmt) { }
+    ~SpoolStatement() { sqlite3_finalize(m_stmt); }
+    sqlite3_stmt* get() const { return m_stmt; }
+    void bind(int i, const char* value) { sqlite3_bind_text(m_stmt, i, value, -1, SQLITE_TRANSIENT); }
+    void bind(int i, const std::string& value) { sqlite3_bind_text(m_stmt, i, value.c_str(), static_cast<int>(value.size()), SQLITE_TRANSIENT); }
+    void bind(int i, long long value) { sqlite3_bind_int64(m_stmt, i, value); }
+    const char* text(int i) const
+    {
+        const unsigned char* value = sqlite3_column_text(m_stmt, i);
+        return (value != NULL ? reinterpret_cast<const char*>(value) : "");
+    }
+};
+
+/// rolls back a transaction unless it has been committed
+class SpoolTransaction
+{
+    sqlite3* m_db;
+    bool m_done;
+public:
+    explicit SpoolTransaction(sqlite3* db) : m_db(db), m_done(false) { }
+    ~SpoolTransaction()
+    {
+        if (!m_done)
+        {
+            sqlite3_exec(m_db, "ROLLBACK", NULL, NULL, NULL);
+        }
+    }
+    void done() { m_done = true; }
+};
+
+PvdumpSpool::PvdumpSpool(const std::string& file_name) : m_file_name(file_name), m_db(NULL)
+{
+    int rc = sqlite3_open_v2(file_name.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
+    if (rc != SQLITE_OK)
+    {
+        std::string msg = "cannot open spool file \"" + file_name + "\": " + (m_db != NULL ? sqlite3_errmsg(m_db) : sqlite3_errstr(rc));
+        sqlite3_close(m_db);
+        m_db = NULL;
+        throw std::runtime_error(msg);
+    }
+    sqlite3_busy_timeout(m_db, BUSY_TIMEOUT_MS);
+    try
+    {
+        // auto_vacuum only takes effect if set before the first table is created
+        exec("PRAGMA auto_vacuum = INCREMENTAL");
+        exec("PRAGMA synchronous = NORMAL");
+        exec(SPOOL_SCHEMA);
+    }
+    catch(...)
+    {
+        sqlite3_close(m_db);
+        m_db = NULL;
+        throw;
+    }
+}
+
+PvdumpSpool::~PvdumpSpool()
+{
+    sqlite3_close(m_db);
+}
+
+void PvdumpSpool::check(int rc, const char* what)
+{
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_ROW)
+    {
+        throw std::runtime_error(std::string("spool file \"") + m_file_name + "\": " + what + ": " + sqlite3_errmsg(m_db));
+    }
+}
+
+void PvdumpSpool::exec(const char* sql)
+{
+    check(sqlite3_exec(m_db, sql, NULL, NULL, NULL), sql);
+}
+
+sqlite3_stmt* PvdumpSpool::prepare(const char* sql)
+{
+    sqlite3_stmt* stmt = NULL;
+    check(sqlite3_prepare_v2(m_db, sql, -1, &stmt, NULL), sql);
+    return stmt;
+}
+
+// remove snapshots of iocname older than id, the caller holds the lock and has a transaction open
+void PvdumpSpool::removeBefore(const std::string& iocname, long long id)
+{
+    static const char* tables[] = { "pvs", "pvinfo", "environ" };
+    for(size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i)
+    {
+        std::string sql = std::string("DELETE FROM ") + tables[i] + " WHERE snapshot IN (SELECT id FROM snapshots WHERE iocname=? AND id<?)";
+        SpoolStatement stmt(prepare(sql.c_str()));
+        stmt.bind(1, iocname);
+        stmt.bind(2, id);
+        check(sqlite3_step(stmt.get()), "remove old snapshots");
+    }
+    SpoolStatement stmt(prepare("DELETE FROM snapshots WHERE iocname=? AND id<?"));
+    stmt.bind(1, iocname);
+    stmt.bind(2, id);
+    check(sqlite3_step(stmt.get()), "remove old snapshots");
+}
+
+long long PvdumpSpool::write(const std::string& iocname, int pid, const std::string& exe_path, const PVCatalog& pvm, const std::list<std::string>& evl)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    exec("BEGIN IMMEDIATE");
+    SpoolTransaction trans(m_db);
+    long long id;
+    {
+        SpoolStatement stmt(prepare("INSERT INTO snapshots (iocname, pid, exe_path) VALUES (?,?,?)"));
+        stmt.bind(1, iocname);
+        stmt.bind(2, static_cast<long long>(pid));
+        stmt.bind(3, exe_path);
+        check(sqlite3_step(stmt.get()), "insert snapshot");
+        id = sqlite3_last_insert_rowid(m_db);
+    }
+    SpoolStatement pvs_stmt(prepare("INSERT INTO pvs (snapshot, pvname, record_type, record_desc) VALUES (?,?,?,?)"));
+    SpoolStatement pvinfo_stmt(prepare("INSERT INTO pvinfo (snapshot, pvname, infoname, value) VALUES (?,?,?,?)"));
+    pvs_stmt.bind(1, id);
+    pvinfo_stmt.bind(1, id);
+    for(size_t i = 0; i < pvm.size(); ++i)
+    {
+        pvs_stmt.bind(2, pvm.name(i));
+        pvs_stmt.bind(3, pvm.recordType(i));
+        pvs_stmt.bind(4, pvm.recordDesc(i));
+        check(sqlite3_step(pvs_stmt.get()), "insert pvs");
+        sqlite3_reset(pvs_stmt.get());
+        for(epicsUInt32 k = pvm.firstInfo(i); k != PVCatalog::NO_INFO; k = pvm.nextInfo(k))
+        {
+            pvinfo_stmt.bind(2, pvm.name(i));
+            pvinfo_stmt.bind(3, pvm.infoName(k));
+            pvinfo_stmt.bind(4, pvm.infoValue(k));
+            check(sqlite3_step(pvinfo_stmt.get()), "insert pvinfo");
+            sqlite3_reset(pvinfo_stmt.get());
+        }
+    }
+    SpoolStatement environ_stmt(prepare("INSERT INTO environ (snapshot, entry) VALUES (?,?)"));
+    environ_stmt.bind(1, id);
+    for(std::list<std::string>::const_iterator it = evl.begin(); it != evl.end(); ++it)
+    {
+        environ_stmt.bind(2, *it);
+        check(sqlite3_step(environ_stmt.get()), "insert environ");
+        sqlite3_reset(environ_stmt.get());
+    }
+    removeBefore(iocname, id);
+    exec("COMMIT");
+    trans.done();
+    // return the pages of any snapshots removed to the file system, outside the transaction so a failure does not lose the snapshot
+    sqlite3_exec(m_db, "PRAGMA incremental_vacuum", NULL, NULL, NULL);
+    return id;
+}
+
+bool PvdumpSpool::readLatest(const std::string& iocname, PvdumpSpoolEntry& entry)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    // a read transaction so the snapshot cannot be replaced part way through
+    exec("BEGIN");
+    SpoolTransaction trans(m_db);
+    {
+        SpoolStatement stmt(prepare("SELECT id, pid, exe_path FROM snapshots WHERE iocname=? ORDER BY id DESC LIMIT 1"));
+        stmt.bind(1, iocname);
+        int rc = sqlite3_step(stmt.get());
+        check(rc, "select snapshot");
+        if (rc != SQLITE_ROW)
+        {
+            return false;
+        }
+        entry.id = sqlite3_column_int64(stmt.get(), 0);
+        entry.pid = sqlite3_column_int(stmt.get(), 1);
+        entry.exe_path = stmt.text(2);
+    }
+    entry.iocname = iocname;
+    entry.pvm.clear();
+    entry.evl.clear();
+    int rc;
+    {
+        SpoolStatement stmt(prepare("SELECT pvname, record_type, record_desc FROM pvs WHERE snapshot=?"));
+        stmt.bind(1, entry.id);
+        while((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            entry.pvm.addPV(stmt.text(0), stmt.text(1), stmt.text(2));
+        }
+        check(rc, "select pvs");
+    }
+    {
+        SpoolStatement stmt(prepare("SELECT pvname, infoname, value FROM pvinfo WHERE snapshot=?"));
+        stmt.bind(1, entry.id);
+        while((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            entry.pvm.addInfo(stmt.text(0), stmt.text(1), stmt.text(2));
+        }
+        check(rc, "select pvinfo");
+    }
+    entry.pvm.finalize();
+    {
+        SpoolStatement stmt(prepare("SELECT entry FROM environ WHERE snapshot=? ORDER BY rowid"));
+        stmt.bind(1, entry.id);
+        while((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            entry.evl.push_back(stmt.text(0));
+        }
+        check(rc, "select environ");
+    }
+    return true;
+}
+
+void PvdumpSpool::remove(long long id)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    exec("BEGIN IMMEDIATE");
+    SpoolTransaction trans(m_db);
+    static const char* sql[] = { "DELETE FROM pvs WHERE snapshot=?", "DELETE FROM pvinfo WHERE snapshot=?",
+                                 "DELETE FROM environ WHERE snapshot=?", "DELETE FROM snapshots WHERE id=?" };
+    for(size_t i = 0; i < sizeof(sql) / sizeof(sql[0]); ++i)
+    {
+        SpoolStatement stmt(prepare(sql[i]));
+        stmt.bind(1, id);
+        check(sqlite3_step(stmt.get()), sql[i]);
+    }
+    exec("COMMIT");
+    trans.done();
+    sqlite3_exec(m_db, "PRAGMA incremental_vacuum", NULL, NULL, NULL);
+}
+
+int PvdumpSpool::count(const std::string& iocname)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    SpoolStatement stmt(prepare("SELECT COUNT(*) FROM snapshots WHERE iocname=?"));
+    stmt.bind(1, iocname);
+    int rc = sqlite3_step(stmt.get());
+    check(rc, "count snapshots");
+    return (rc == SQLITE_ROW ? sqlite3_column_int(stmt.get(), 0) : 0);
+}
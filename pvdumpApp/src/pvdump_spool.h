@@ -0,0 +1,63 @@
+///
+/// @file pvdump_spool.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Local SQLite spool of pvdump snapshots, written before they are sent to MySQL
+///
+#ifndef PVDUMP_SPOOL_H
+#define PVDUMP_SPOOL_H
+
+#include <string>
+#include <list>
+
+#include <epicsMutex.h>
+
+#include "pvdump_catalog.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+/// a snapshot of what pvdump would write to MySQL for an IOC
+struct PvdumpSpoolEntry
+{
+    long long id;
+    std::string iocname;
+    int pid;
+    std::string exe_path;
+    PVCatalog pvm;                  ///< finalized
+    std::list<std::string> evl;     ///< name=value environment strings
+    PvdumpSpoolEntry() : id(0), pid(0) { }
+};
+
+/// The spool file may be shared by several IOCs on a machine. Writing a snapshot for an IOC removes
+/// any older snapshots of that IOC, so there is at most one waiting per IOC. Errors throw std::runtime_error.
+class PvdumpSpool
+{
+public:
+    explicit PvdumpSpool(const std::string& file_name);
+    ~PvdumpSpool();
+    /// write a snapshot in a single transaction, replacing older ones of the same IOC, returns its id
+    long long write(const std::string& iocname, int pid, const std::string& exe_path, const PVCatalog& pvm, const std::list<std::string>& evl);
+    /// the newest snapshot of iocname, false if there is none
+    bool readLatest(const std::string& iocname, PvdumpSpoolEntry& entry);
+    /// remove a snapshot once it has been written to MySQL
+    void remove(long long id);
+    /// number of snapshots waiting for iocname
+    int count(const std::string& iocname);
+    const std::string& fileName() const { return m_file_name; }
+
+private:
+    epicsMutex m_lock;
+    std::string m_file_name;
+    sqlite3* m_db;
+
+    void exec(const char* sql);
+    sqlite3_stmt* prepare(const char* sql);
+    void check(int rc, const char* what);
+    void removeBefore(const std::string& iocname, long long id);
+
+    PvdumpSpool(const PvdumpSpool&);
+    PvdumpSpool& operator=(const PvdumpSpool&);
+};
+
+#endif /* PVDUMP_SPOOL_H */
@@ -0,0 +1,248 @@
+///
+/// @file pvdump_sqlscript.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Split a file of SQL into statements for sqlexec
+///
+#include <ctype.h>
+#include <string>
+#include <stdexcept>
+
+#include "pvdump_sqlscript.h"
+
+PvdumpSqlScript::PvdumpSqlScript(const std::string& file_name) : m_start_line(0), m_delimiter(";"), m_state(Normal),
+    m_statement_line(0), m_lines(0), m_bytes(0), m_size(-1), m_line_mode(false)
+{
+    // binary so the byte count matches the file, \r is removed from line ends below
+    m_fs.open(file_name.c_str(), std::ios::in | std::ios::binary);
+    if (!m_fs.is_open())
+    {
+        throw std::runtime_error("cannot open \"" + file_name + "\"");
+    }
+    if (m_fs.seekg(0, std::ios::end))
+    {
+        m_size = static_cast<long long>(m_fs.tellg());
+    }
+    m_fs.clear();
+    m_fs.seekg(0, std::ios::beg);
+    m_line_mode = !hasDelimiter();
+    m_fs.clear();
+    m_fs.seekg(0, std::ios::beg);
+    m_statement.clear();
+    m_complete.clear();
+    m_start_line = 0;
+    m_delimiter = ";";
+    m_state = Normal;
+    m_lines = 0;
+    m_bytes = 0;
+}
+
+// true if a statement ends with the delimiter or there is a DELIMITER line, read before the statements are
+bool PvdumpSqlScript::hasDelimiter()
+{
+    while(readLine())
+    {
+        if (m_state == Normal && m_start_line == 0 && setDelimiter())
+        {
+            return true;
+        }
+        parseLine();
+        if (!m_complete.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the next line into m_line without any \r, false at the end of the file
+bool PvdumpSqlScript::readLine()
+{
+    if (!std::getline(m_fs, m_line))
+    {
+        if (m_fs.bad())
+        {
+            throw std::runtime_error("error reading SQL file");
+        }
+        return false;
+    }
+    ++m_lines;
+    m_bytes += m_line.size() + (m_fs.eof() ? 0 : 1);
+    if (!m_line.empty() && m_line[m_line.size() - 1] == '\r')
+    {
+        m_line.resize(m_line.size() - 1);
+    }
+    return true;
+}
+
+bool PvdumpSqlScript::next(std::string& statement)
+{
+    while(m_complete.empty())
+    {
+        if (!readLine())
+        {
+            endStatement(); // the last statement need not have a delimiter
+            if (m_complete.empty())
+            {
+                return false;
+            }
+            break;
+        }
+        parseLine();
+        if (m_line_mode && m_state == Normal)
+        {
+            endStatement(); // a statement spanning lines only carries on inside quotes or a comment
+        }
+    }
+    statement.swap(m_complete.front().first);
+    m_statement_line = m_complete.front().second;
+    m_complete.pop_front();
+    return true;
+}
+
+// a "DELIMITER xx" line, only recognised between statements
+bool PvdumpSqlScript::setDelimiter()
+{
+    static const char keyword[] = "delimiter";
+    size_t i = 0, n = m_line.size();
+    while(i < n && isspace(static_cast<unsigned char>(m_line[i])))
+    {
+        ++i;
+    }
+    for(size_t j = 0; j < sizeof(keyword) - 1; ++j, ++i)
+    {
+        if (i >= n || tolower(static_cast<unsigned char>(m_line[i])) != keyword[j])
+        {
+            return false;
+        }
+    }
+    if (i >= n || !isspace(static_cast<unsigned char>(m_line[i])))
+    {
+        return false;
+    }
+    while(i < n && isspace(static_cast<unsigned char>(m_line[i])))
+    {
+        ++i;
+    }
+    size_t start = i;
+    while(i < n && !isspace(static_cast<unsigned char>(m_line[i])))
+    {
+        ++i;
+    }
+    if (i == start)
+    {
+        return false;
+    }
+    m_delimiter = m_line.substr(start, i - start);
+    return true;
+}
+
+void PvdumpSqlScript::parseLine()
+{
+    if (m_state == Normal && m_start_line == 0 && setDelimiter())
+    {
+        return;
+    }
+    const size_t n = m_line.size();
+    size_t i = 0;
+    while(i < n)
+    {
+        char c = m_line[i];
+        switch(m_state)
+        {
+            case Normal:
+                if (m_line.compare(i, m_delimiter.size(), m_delimiter) == 0)
+                {
+                    endStatement();
+                    i += m_delimiter.size();
+                    continue;
+                }
+                if (c == '#' || (c == '-' && i + 1 < n && m_line[i + 1] == '-' && (i + 2 == n || isspace(static_cast<unsigned char>(m_line[i + 2])))))
+                {
+                    i = n; // comment to end of line
+                    continue;
+                }
+                // /*! and /*+ are executable comments and optimizer hints, so are kept
+                if (c == '/' && i + 1 < n && m_line[i + 1] == '*' && !(i + 2 < n && (m_line[i + 2] == '!' || m_line[i + 2] == '+')))
+                {
+                    m_state = BlockComment;
+                    i += 2;
+                    continue;
+                }
+                if (c == '\'')
+                {
+                    m_state = SingleQuote;
+                }
+                else if (c == '"')
+                {
+                    m_state = DoubleQuote;
+                }
+                else if (c == '`')
+                {
+                    m_state = BackQuote;
+                }
+                append(c);
+                ++i;
+                break;
+
+            case SingleQuote:
+            case DoubleQuote:
+            case BackQuote:
+                append(c);
+                if (c == '\\' && m_state != BackQuote && i + 1 < n)
+                {
+                    append(m_line[i + 1]);
+                    i += 2;
+                    continue;
+                }
+                if ( (c == '\'' && m_state == SingleQuote) || (c == '"' && m_state == DoubleQuote) || (c == '`' && m_state == BackQuote) )
+                {
+                    m_state = Normal; // a doubled quote just closes and reopens
+                }
+                ++i;
+                break;
+
+            case BlockComment:
+                if (c == '*' && i + 1 < n && m_line[i + 1] == '/')
+                {
+                    m_state = Normal;
+                    append(' '); // a comment separates the words either side of it
+                    i += 2;
+                    continue;
+                }
+                ++i;
+                break;
+        }
+    }
+    if (m_state != BlockComment)
+    {
+        append('\n');
+    }
+}
+
+// leading white space is dropped, m_start_line is set by the first character kept
+void PvdumpSqlScript::append(char c)
+{
+    if (m_start_line == 0)
+    {
+        if (isspace(static_cast<unsigned char>(c)))
+        {
+            return;
+        }
+        m_start_line = m_lines;
+    }
+    m_statement += c;
+}
+
+void PvdumpSqlScript::endStatement()
+{
+    if (m_start_line == 0)
+    {
+        return;
+    }
+    size_t end = m_statement.find_last_not_of(" \t\r\n");
+    m_statement.resize(end + 1); // there is at least one non space character
+    m_complete.push_back(std::pair<std::string, unsigned long>(std::string(), m_start_line));
+    m_complete.back().first.swap(m_statement);
+    m_start_line = 0;
+}
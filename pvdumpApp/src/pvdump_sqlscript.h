@@ -0,0 +1,66 @@
+///
+/// @file pvdump_sqlscript.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Split a file of SQL into statements for sqlexec
+///
+#ifndef PVDUMP_SQLSCRIPT_H
+#define PVDUMP_SQLSCRIPT_H
+
+#include <string>
+#include <deque>
+#include <fstream>
+
+/// Reads a file of SQL a line at a time and returns the statements in it, so a script of any size or
+/// statement of any length can be run. Statements end with the delimiter, initially ";", and may span
+/// lines. As with the mysql command line client a delimiter inside quotes or comments does not count,
+/// -- and # comments and /* */ comments other than /*! and /*+ are removed, and a "DELIMITER xx" line
+/// changes the delimiter. A final statement without a delimiter is still returned.
+///
+/// A script with no delimiter or DELIMITER line at all is taken to be one statement per line, as sqlexec ran
+/// scripts before delimiters were recognised. Finding out means reading the file once before the statements.
+class PvdumpSqlScript
+{
+public:
+    /// throws std::runtime_error if the file cannot be opened
+    explicit PvdumpSqlScript(const std::string& file_name);
+    /// the next statement without its delimiter, false at the end of the file
+    bool next(std::string& statement);
+    /// line of the file the statement last returned by next() started on
+    unsigned long statementLine() const { return m_statement_line; }
+    /// lines and bytes read so far
+    unsigned long lines() const { return m_lines; }
+    long long bytesRead() const { return m_bytes; }
+    /// size of the file, -1 if not known
+    long long size() const { return m_size; }
+    /// each line is a statement, as the script has no delimiters
+    bool lineMode() const { return m_line_mode; }
+
+private:
+    enum State { Normal, SingleQuote, DoubleQuote, BackQuote, BlockComment };
+
+    std::ifstream m_fs;
+    std::string m_line;
+    std::string m_statement;               ///< text of the statement being read
+    unsigned long m_start_line;            ///< line m_statement started on, 0 if it is still blank
+    std::deque< std::pair<std::string, unsigned long> > m_complete; ///< statements and start lines read but not yet returned
+    std::string m_delimiter;
+    State m_state;
+    unsigned long m_statement_line;
+    unsigned long m_lines;
+    long long m_bytes;
+    long long m_size;
+    bool m_line_mode;
+
+    bool readLine();
+    void parseLine();
+    bool hasDelimiter();
+    bool setDelimiter();
+    void append(char c);
+    void endStatement();
+
+    PvdumpSqlScript(const PvdumpSqlScript&);
+    PvdumpSqlScript& operator=(const PvdumpSqlScript&);
+};
+
+#endif /* PVDUMP_SQLSCRIPT_H */
@@ -0,0 +1,234 @@
+///
+/// @file pvdump_stats.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Wall clock timings of pvdump phases and SQL statements
+///
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+
+#include "pvdump_stats.h"
+
+// upper limits of all but the last histogram bucket
+static const double BUCKET_LIMITS[PVDUMP_STATS_BUCKETS - 1] = { 0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05,
+                                                                0.1, 0.2, 0.5, 1.0, 2.0, 5.0, 10.0 };
+
+PvdumpStats& PvdumpStats::instance()
+{
+    // never deleted, statements may still be timed by exit handlers
+    static PvdumpStats* stats = new PvdumpStats;
+    return *stats;
+}
+
+double PvdumpStats::bucketLimit(int bucket)
+{
+    return (bucket >= 0 && bucket < PVDUMP_STATS_BUCKETS - 1 ? BUCKET_LIMITS[bucket] : 0.0);
+}
+
+void PvdumpStats::add(TimingList& timings, const std::string& name, double seconds)
+{
+    size_t i;
+    for(i = 0; i < timings.size() && timings[i].first != name; ++i)
+        ;
+    if (i == timings.size())
+    {
+        pvdumpTiming timing;
+        memset(&timing, 0, sizeof(timing));
+        strncpy(timing.name, name.c_str(), sizeof(timing.name) - 1);
+        timings.push_back(std::make_pair(name, timing));
+    }
+    pvdumpTiming& timing = timings[i].second;
+    int bucket;
+    for(bucket = 0; bucket < PVDUMP_STATS_BUCKETS - 1 && seconds > BUCKET_LIMITS[bucket]; ++bucket)
+        ;
+    ++timing.hist[bucket];
+    ++timing.count;
+    timing.last = seconds;
+    timing.total += seconds;
+    if (seconds > timing.max)
+    {
+        timing.max = seconds;
+    }
+}
+
+void PvdumpStats::addPhase(const char* name, double seconds)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    add(m_phases, name, seconds);
+}
+
+void PvdumpStats::addStatement(const std::string& type, double seconds)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    add(m_statements, type, seconds);
+}
+
+void PvdumpStats::reset()
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    m_phases.clear();
+    m_statements.clear();
+}
+
+int PvdumpStats::get(const TimingList& timings, pvdumpTiming* result, int max)
+{
+    for(int i = 0; i < max && i < static_cast<int>(timings.size()); ++i)
+    {
+        result[i] = timings[i].second;
+    }
+    return static_cast<int>(timings.size());
+}
+
+int PvdumpStats::getPhases(pvdumpTiming* timings, int max)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    return get(m_phases, timings, max);
+}
+
+int PvdumpStats::getStatements(pvdumpTiming* timings, int max)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    return get(m_statements, timings, max);
+}
+
+void PvdumpStats::report(FILE* fp, const char* title, const TimingList& timings, int level)
+{
+    fprintf(fp, "%-24s %8s %12s %12s %12s %12s\n", title, "count", "last (s)", "mean (s)", "max (s)", "total (s)");
+    for(size_t i = 0; i < timings.size(); ++i)
+    {
+        const pvdumpTiming& t = timings[i].second;
+        fprintf(fp, "%-24s %8lu %12.6f %12.6f %12.6f %12.6f\n", t.name, t.count, t.last, (t.count > 0 ? t.total / t.count : 0.0), t.max, t.total);
+        if (level < 2)
+        {
+            continue;
+        }
+        for(int b = 0; b < PVDUMP_STATS_BUCKETS; ++b)
+        {
+            if (t.hist[b] == 0)
+            {
+                continue;
+            }
+            if (b < PVDUMP_STATS_BUCKETS - 1)
+            {
+                fprintf(fp, "    <= %-10g %8lu\n", BUCKET_LIMITS[b], t.hist[b]);
+            }
+            else
+            {
+                fprintf(fp, "    >  %-10g %8lu\n", BUCKET_LIMITS[b - 1], t.hist[b]);
+            }
+        }
+    }
+}
+
+void PvdumpStats::report(FILE* fp, int level)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    report(fp, "phase", m_phases, level);
+    if (level >= 1)
+    {
+        fprintf(fp, "\n");
+        report(fp, "statement", m_statements, level);
+    }
+}
+
+static std::string upperCase(const std::string& s)
+{
+    std::string res(s);
+    for(size_t i = 0; i < res.size(); ++i)
+    {
+        res[i] = toupper(res[i]);
+    }
+    return res;
+}
+
+std::string PvdumpStats::statementType(const std::string& sql)
+{
+    std::istringstream iss(sql);
+    std::vector<std::string> words;
+    std::string word;
+    // the table name is never far from the start
+    while(words.size() < 12 && iss >> word)
+    {
+        words.push_back(word);
+    }
+    if (words.empty())
+    {
+        return "";
+    }
+    std::string verb = upperCase(words[0]);
+    std::string table;
+    const char* after = NULL;
+    size_t skip = 0;
+    if (verb == "INSERT" || verb == "REPLACE")
+    {
+        after = "INTO";
+    }
+    else if (verb == "LOAD")
+    {
+        after = "TABLE";
+    }
+    else if (verb == "SELECT")
+    {
+        after = "FROM";
+    }
+    else if (verb == "CREATE" || verb == "DROP" || verb == "TRUNCATE")
+    {
+        after = "TABLE";
+    }
+    else if (verb == "UPDATE")
+    {
+        skip = 1;
+    }
+    else if (verb == "DELETE")
+    {
+        // "DELETE FROM t ..." or "DELETE t FROM t INNER JOIN ..."
+        skip = (words.size() > 1 && upperCase(words[1]) == "FROM" ? 2 : 1);
+    }
+    if (after != NULL)
+    {
+        for(size_t i = 1; i + 1 < words.size(); ++i)
+        {
+            if (upperCase(words[i]) == after)
+            {
+                skip = i + 1;
+                break;
+            }
+        }
+        // "CREATE TEMPORARY TABLE IF NOT EXISTS t", "DROP TABLE IF EXISTS t"
+        if (skip > 0 && skip < words.size() && upperCase(words[skip]) == "IF")
+        {
+            for(; skip < words.size() && upperCase(words[skip]) != "EXISTS"; ++skip)
+                ;
+            ++skip;
+        }
+    }
+    if (skip > 0 && skip < words.size())
+    {
+        table = words[skip];
+        size_t end = table.find_first_of("(,;");
+        if (end != std::string::npos)
+        {
+            table.erase(end);
+        }
+        std::string::iterator it;
+        while((it = std::find(table.begin(), table.end(), '`')) != table.end())
+        {
+            table.erase(it);
+        }
+    }
+    std::string type = (table.empty() ? verb : verb + " " + table);
+    if (type.size() >= PVDUMP_STATS_NAME_SIZE)
+    {
+        type.erase(PVDUMP_STATS_NAME_SIZE - 1);
+    }
+    return type;
+}
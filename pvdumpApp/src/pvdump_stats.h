@@ -0,0 +1,72 @@
+///
+/// @file pvdump_stats.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Wall clock timings of pvdump phases and SQL statements
+///
+#ifndef PVDUMP_STATS_H
+#define PVDUMP_STATS_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "pvdump.h"
+
+/// Phases are named parts of a pvdump e.g. "scan" or "cleanup", statements are grouped by type
+/// e.g. "INSERT pvinfo" or "COMMIT". For each we keep a count, the last, total and maximum time
+/// and a histogram of times with 1-2-5 bucket limits from 0.1ms to 10s.
+class PvdumpStats
+{
+public:
+    static PvdumpStats& instance();
+    void addPhase(const char* name, double seconds);
+    void addStatement(const std::string& type, double seconds);
+    void reset();
+    /// level 0 phases, 1 adds statements, 2 adds histograms
+    void report(FILE* fp, int level);
+    /// fill up to max timings, returns the number available
+    int getPhases(pvdumpTiming* timings, int max);
+    int getStatements(pvdumpTiming* timings, int max);
+    /// upper limit in seconds of histogram bucket, 0.0 for the last bucket which has no limit
+    static double bucketLimit(int bucket);
+    /// statement type of sql for grouping, the verb and table e.g. "DELETE pvs"
+    static std::string statementType(const std::string& sql);
+
+private:
+    typedef std::vector< std::pair<std::string, pvdumpTiming> > TimingList; ///< in the order first seen
+    epicsMutex m_lock;
+    TimingList m_phases;
+    TimingList m_statements;
+
+    static void add(TimingList& timings, const std::string& name, double seconds);
+    static int get(const TimingList& timings, pvdumpTiming* result, int max);
+    static void report(FILE* fp, const char* title, const TimingList& timings, int level);
+};
+
+/// adds the wall clock time from construction to destruction to the pvdump statistics as a phase
+class PvdumpPhaseTimer
+{
+    const char* m_name;
+    epicsTime m_start;
+public:
+    explicit PvdumpPhaseTimer(const char* name) : m_name(name), m_start(epicsTime::getCurrent()) { }
+    ~PvdumpPhaseTimer() { PvdumpStats::instance().addPhase(m_name, epicsTime::getCurrent() - m_start); }
+    double elapsed() const { return epicsTime::getCurrent() - m_start; }
+};
+
+/// adds the wall clock time from construction to destruction to the pvdump statistics as a statement
+class PvdumpStatementTimer
+{
+    std::string m_type;
+    epicsTime m_start;
+public:
+    explicit PvdumpStatementTimer(const std::string& type) : m_type(type), m_start(epicsTime::getCurrent()) { }
+    ~PvdumpStatementTimer() { PvdumpStats::instance().addStatement(m_type, epicsTime::getCurrent() - m_start); }
+};
+
+#endif /* PVDUMP_STATS_H */
@@ -0,0 +1,151 @@
+///
+/// @file pvdump_status.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Publish pvdump health and throughput to the records of pvdump.db
+///
+#include <string.h>
+#include <string>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+
+#include "pvdump_status.h"
+
+PvdumpStatus& PvdumpStatus::instance()
+{
+    // never deleted, the writer thread may still be running at exit
+    static PvdumpStatus* status = new PvdumpStatus;
+    return *status;
+}
+
+PvdumpStatus::PvdumpStatus() : m_start(epicsTime::getCurrent()), m_last_success(m_start), m_have_success(false), m_status(Idle),
+    m_duration(0.0), m_rows(0), m_queue_depth(0), m_retries(0), m_lock_retries(0), m_bytes(0.0)
+{
+}
+
+void PvdumpStatus::setPrefix(const std::string& prefix)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    m_prefix = prefix;
+}
+
+void PvdumpStatus::started()
+{
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        m_start = epicsTime::getCurrent();
+        m_status = Running;
+    }
+    publish();
+}
+
+void PvdumpStatus::finished(bool ok, unsigned long rows)
+{
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        epicsTime now = epicsTime::getCurrent();
+        m_duration = now - m_start;
+        m_status = (ok ? OK : Failed);
+        m_rows = rows;
+        if (ok)
+        {
+            m_last_success = now;
+            m_have_success = true;
+        }
+    }
+    publish();
+}
+
+// bytes and retries are only published at the end of a sync, they change too often to write each time
+void PvdumpStatus::addBytes(size_t nbytes)
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    m_bytes += static_cast<double>(nbytes);
+}
+
+void PvdumpStatus::addRetry()
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    ++m_retries;
+}
+
+void PvdumpStatus::addLockRetry()
+{
+    epicsGuard<epicsMutex> _lock(m_lock);
+    ++m_retries;
+    ++m_lock_retries;
+}
+
+void PvdumpStatus::setQueueDepth(int depth)
+{
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        m_queue_depth = depth;
+    }
+    publish();
+}
+
+// returns false if the record is not loaded
+bool PvdumpStatus::put(const std::string& prefix, const char* name, short dbr_type, const void* value)
+{
+    DBADDR addr;
+    std::string pvname = prefix + name;
+    if (dbNameToAddr(pvname.c_str(), &addr) != 0)
+    {
+        return false;
+    }
+    dbPutField(&addr, dbr_type, value, 1);
+    return true;
+}
+
+void PvdumpStatus::publish()
+{
+    if (pdbbase == NULL || !interruptAccept)
+    {
+        return;
+    }
+    std::string prefix;
+    epicsEnum16 status;
+    double duration, bytes, last_success_secs = 0.0;
+    epicsInt32 rows, queue_depth, retries, lock_retries;
+    char last_success[MAX_STRING_SIZE];
+    last_success[0] = '\0';
+    {
+        epicsGuard<epicsMutex> _lock(m_lock);
+        prefix = m_prefix;
+        status = static_cast<epicsEnum16>(m_status);
+        duration = m_duration;
+        rows = static_cast<epicsInt32>(m_rows);
+        queue_depth = m_queue_depth;
+        retries = static_cast<epicsInt32>(m_retries);
+        lock_retries = static_cast<epicsInt32>(m_lock_retries);
+        bytes = m_bytes;
+        if (m_have_success)
+        {
+            m_last_success.strftime(last_success, sizeof(last_success), "%Y-%m-%d %H:%M:%S");
+            epicsTimeStamp ts = m_last_success;
+            last_success_secs = static_cast<double>(ts.secPastEpoch) + POSIX_TIME_AT_EPICS_EPOCH;
+        }
+    }
+    // the status record is checked first so we do nothing more if pvdump.db has not been loaded
+    if (!put(prefix, "STATUS", DBR_ENUM, &status))
+    {
+        return;
+    }
+    put(prefix, "DURATION", DBR_DOUBLE, &duration);
+    put(prefix, "ROWS", DBR_LONG, &rows);
+    put(prefix, "QUEUE", DBR_LONG, &queue_depth);
+    put(prefix, "RETRIES", DBR_LONG, &retries);
+    put(prefix, "LOCK_RETRIES", DBR_LONG, &lock_retries);
+    put(prefix, "BYTES", DBR_DOUBLE, &bytes);
+    if (last_success[0] != '\0')
+    {
+        put(prefix, "LAST_SUCCESS", DBR_STRING, last_success);
+        put(prefix, "LAST_SUCCESS:SECS", DBR_DOUBLE, &last_success_secs);
+    }
+}
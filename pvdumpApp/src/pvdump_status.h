@@ -0,0 +1,54 @@
+///
+/// @file pvdump_status.h
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Publish pvdump health and throughput to the records of pvdump.db
+///
+#ifndef PVDUMP_STATUS_H
+#define PVDUMP_STATUS_H
+
+#include <string>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
+
+/// Keeps counters across pvdump runs and writes them to the pvdump.db records, if they
+/// have been loaded into this IOC. Nothing is written before iocInit or in non-IOC programs.
+class PvdumpStatus
+{
+public:
+    enum SyncStatus { Idle = 0, Running = 1, OK = 2, Failed = 3 }; ///< must agree with $(P)STATUS in pvdump.db
+    static PvdumpStatus& instance();
+    /// record names are prefix + e.g. "STATUS"
+    void setPrefix(const std::string& prefix);
+    void started();
+    /// rows are those written to the database by this sync
+    void finished(bool ok, unsigned long rows);
+    void addBytes(size_t nbytes);
+    void addRetry();
+    /// a chunk retried after a deadlock or lock wait timeout, also counted by addRetry()
+    void addLockRetry();
+    /// requests waiting to be written, or being written
+    void setQueueDepth(int depth);
+
+private:
+    epicsMutex m_lock;
+    std::string m_prefix;
+    epicsTime m_start;
+    epicsTime m_last_success;
+    bool m_have_success;
+    int m_status;
+    double m_duration;
+    unsigned long m_rows;
+    int m_queue_depth;
+    unsigned long m_retries;
+    unsigned long m_lock_retries;
+    double m_bytes;
+
+    PvdumpStatus();
+    void publish();
+    bool put(const std::string& prefix, const char* name, short dbr_type, const void* value);
+};
+
+#endif /* PVDUMP_STATUS_H */
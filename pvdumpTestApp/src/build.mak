@@ -46,6 +46,39 @@ $(APPNAME)_SRCS_vxWorks += -nil-
 # Finally link to the EPICS Base libraries
 $(APPNAME)_LIBS += $(EPICS_BASE_IOC_LIBS)
 
+# pvdumpBench times pvdump against a generated database, see pvdumpBenchMain.cpp
+# pvdumpBench writes to the in-memory pvdump_mysqlmock backend, pvdumpBenchMysql to MYSQLHOST
+PROD_IOC += pvdumpBench pvdumpBenchMysql
+DBD += pvdumpBench.dbd
+pvdumpBench_DBD += base.dbd
+pvdumpBench_DBD += pvdump.dbd
+pvdumpBench_SRCS += pvdumpBench_registerRecordDeviceDriver.cpp pvdumpBenchMain.cpp
+pvdumpBench_LIBS += pvdump_mock pvdump_mysqlmock easySQLite sqlite utilities pcre
+pvdumpBench_LIBS += $(EPICS_BASE_IOC_LIBS)
+pvdumpBench_SYS_LIBS_WIN32 += psapi
+pvdumpBenchMysql_SRCS += pvdumpBench_registerRecordDeviceDriver.cpp pvdumpBenchMain.cpp
+pvdumpBenchMysql_LIBS += pvdump $(MYSQLLIB) easySQLite sqlite utilities pcre
+pvdumpBenchMysql_LIBS += $(EPICS_BASE_IOC_LIBS)
+pvdumpBenchMysql_SYS_LIBS_WIN32 += psapi
+
+# pvdumpMockTest checks the SQL pvdump sends for each kind of write, against pvdump_mysqlmock
+TESTPROD_HOST += pvdumpMockTest
+pvdumpMockTest_SRCS += pvdumpMockTest.cpp
+pvdumpMockTest_LIBS += pvdump_mock pvdump_mysqlmock easySQLite sqlite utilities pcre
+pvdumpMockTest_LIBS += $(EPICS_BASE_IOC_LIBS)
+TESTS += pvdumpMockTest
+
+# pvdumpCatalogTest checks a catalog that is added to and removed from does not keep growing
+TESTPROD_HOST += pvdumpCatalogTest
+pvdumpCatalogTest_SRCS += pvdumpCatalogTest.cpp pvdump_catalog.cpp
+pvdumpCatalogTest_LIBS += $(EPICS_BASE_IOC_LIBS)
+TESTS += pvdumpCatalogTest
+TESTSCRIPTS_HOST += $(TESTS:%=%.t)
+
+# pvdump_catalog.cpp and its header are private to pvdumpApp
+SRC_DIRS += $(TOP)/pvdumpApp/src
+USR_INCLUDES += -I$(TOP)/pvdumpApp/src
+
 #===========================
 
 include $(TOP)/configure/RULES
@@ -0,0 +1,362 @@
+///
+/// @file pvdumpBenchMain.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Benchmark pvdump against a generated database. Built as pvdumpBench, which writes
+/// to the in-memory pvdump_mysqlmock backend, and pvdumpBenchMysql, which writes to
+/// the MySQL server given by MYSQLHOST.
+///
+/// A .db file is generated with the requested number of records, record type mix, DESC length and
+/// info fields per record, loaded, and then pvdump is run against it. The wall time, peak RSS
+/// and rows/sec of each phase are written as one JSON object per line, so results can be
+/// compared between releases. Run from the top of the pvdump tree, or use -D to give the dbd file.
+///
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "epicsExit.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "epicsStdlib.h"
+#include "epicsStdio.h"
+#include "envDefs.h"
+#include "iocsh.h"
+
+#include "pvdump.h"
+
+static const int MAX_DESC_LENGTH = 40; // DESC field is a 41 character string
+
+struct BenchOptions
+{
+    int nrecords;
+    std::string type_mix;
+    int desc_length;
+    int ninfo;
+    int repeats;
+    double timeout;
+    std::string prefix;
+    std::string ioc_name;
+    std::string load_mode;
+    std::string label;
+    std::string dbd_file;
+    std::string db_file;
+    std::string output_file;
+    bool keep_db;
+
+    BenchOptions() : nrecords(10000), type_mix("ai:4,bo:2,stringin:2,calc:1,longout:1"), desc_length(20), ninfo(2), repeats(1),
+                     timeout(3600.0), prefix("BENCH"), ioc_name("PVDUMPBENCH"), dbd_file("dbd/pvdumpBench.dbd"),
+                     db_file("pvdumpBench.db"), output_file("pvdumpBench.jsonl"), keep_db(false) { }
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "  -n records     number of records to generate (default 10000)\n");
+    fprintf(stderr, "  -t type_mix    record types and relative weights (default ai:4,bo:2,stringin:2,calc:1,longout:1)\n");
+    fprintf(stderr, "  -d length      DESC length, at most %d (default 20)\n", MAX_DESC_LENGTH);
+    fprintf(stderr, "  -i count       info fields per record (default 2)\n");
+    fprintf(stderr, "  -r repeats     number of times to run pvdump (default 1)\n");
+    fprintf(stderr, "  -w seconds     time to wait for each pvdump to finish (default 3600)\n");
+    fprintf(stderr, "  -p prefix      record name prefix (default BENCH)\n");
+    fprintf(stderr, "  -I iocname     IOC name to use for pvdump (default PVDUMPBENCH)\n");
+    fprintf(stderr, "  -m mode        pvdump load mode, insert or bulk (default from PVDUMP_LOAD)\n");
+    fprintf(stderr, "  -L label       label included in the results, e.g. the release being tested\n");
+    fprintf(stderr, "  -D dbdfile     dbd file to load (default dbd/pvdumpBench.dbd)\n");
+    fprintf(stderr, "  -f dbfile      generated db file (default pvdumpBench.db)\n");
+    fprintf(stderr, "  -o outfile     results file, - for stdout (default pvdumpBench.jsonl)\n");
+    fprintf(stderr, "  -k             keep the generated db file\n");
+}
+
+static bool parseOptions(int argc, char* argv[], BenchOptions& opts)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        const char* opt = argv[i];
+        if (strcmp(opt, "-k") == 0)
+        {
+            opts.keep_db = true;
+            continue;
+        }
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc)
+        {
+            return false;
+        }
+        const char* val = argv[++i];
+        epicsInt32 ival = 0;
+        double dval = 0.0;
+        switch(opt[1])
+        {
+            case 'n':
+                if (epicsParseInt32(val, &ival, 10, NULL) != 0 || ival < 1)
+                    return false;
+                opts.nrecords = ival;
+                break;
+            case 'd':
+                if (epicsParseInt32(val, &ival, 10, NULL) != 0 || ival < 0 || ival > MAX_DESC_LENGTH)
+                    return false;
+                opts.desc_length = ival;
+                break;
+            case 'i':
+                if (epicsParseInt32(val, &ival, 10, NULL) != 0 || ival < 0)
+                    return false;
+                opts.ninfo = ival;
+                break;
+            case 'r':
+                if (epicsParseInt32(val, &ival, 10, NULL) != 0 || ival < 1)
+                    return false;
+                opts.repeats = ival;
+                break;
+            case 'w':
+                if (epicsParseDouble(val, &dval, NULL) != 0 || dval <= 0.0)
+                    return false;
+                opts.timeout = dval;
+                break;
+            case 't':
+                opts.type_mix = val;
+                break;
+            case 'p':
+                opts.prefix = val;
+                break;
+            case 'I':
+                opts.ioc_name = val;
+                break;
+            case 'm':
+                opts.load_mode = val;
+                break;
+            case 'L':
+                opts.label = val;
+                break;
+            case 'D':
+                opts.dbd_file = val;
+                break;
+            case 'f':
+                opts.db_file = val;
+                break;
+            case 'o':
+                opts.output_file = val;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// parse "type:weight,type:weight" into one entry per unit of weight, so record i is of type types[i % types.size()]
+static bool parseTypeMix(const std::string& mix, std::vector<std::string>& types)
+{
+    size_t start = 0;
+    while(start < mix.size())
+    {
+        size_t end = mix.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = mix.size();
+        }
+        std::string item = mix.substr(start, end - start);
+        start = end + 1;
+        epicsInt32 weight = 1;
+        size_t colon = item.find(':');
+        if (colon != std::string::npos)
+        {
+            if (epicsParseInt32(item.c_str() + colon + 1, &weight, 10, NULL) != 0 || weight < 0)
+            {
+                return false;
+            }
+            item.erase(colon);
+        }
+        if (item.empty())
+        {
+            return false;
+        }
+        types.insert(types.end(), weight, item);
+    }
+    return !types.empty();
+}
+
+static bool generateDb(const BenchOptions& opts, const std::vector<std::string>& types)
+{
+    FILE* fp = fopen(opts.db_file.c_str(), "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "pvdumpBench: cannot write \"%s\"\n", opts.db_file.c_str());
+        return false;
+    }
+    std::string desc_pad(MAX_DESC_LENGTH, 'D');
+    char name[64], desc[64];
+    for(int i = 0; i < opts.nrecords; ++i)
+    {
+        const std::string& type = types[i % types.size()];
+        epicsSnprintf(name, sizeof(name), "%s:%s:%07d", opts.prefix.c_str(), type.c_str(), i);
+        // start with the record number so DESC values differ
+        epicsSnprintf(desc, sizeof(desc), "%d %s", i, desc_pad.c_str());
+        desc[opts.desc_length] = '\0';
+        fprintf(fp, "record(%s, \"%s\")\n{\n    field(DESC, \"%s\")\n", type.c_str(), name, desc);
+        for(int j = 0; j < opts.ninfo; ++j)
+        {
+            fprintf(fp, "    info(benchinfo%d, \"value %d of %s\")\n", j, j, name);
+        }
+        fprintf(fp, "}\n\n");
+    }
+    fclose(fp);
+    return true;
+}
+
+// peak resident set size of this process in KiB
+static unsigned long peakRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    {
+        return static_cast<unsigned long>(pmc.PeakWorkingSetSize / 1024);
+    }
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<unsigned long>(ru.ru_maxrss / 1024); // bytes on macOS
+#else
+    return static_cast<unsigned long>(ru.ru_maxrss);
+#endif
+#endif
+}
+
+// strings we output are our own options, so only quotes and backslashes need escaping
+static std::string jsonString(const std::string& s)
+{
+    std::string res("\"");
+    for(size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '"' || s[i] == '\\')
+        {
+            res += '\\';
+        }
+        res += s[i];
+    }
+    return res + "\"";
+}
+
+static void writeResult(FILE* fp, const BenchOptions& opts, const std::string& program, int run, const char* phase,
+                        double seconds, unsigned long rows, unsigned long peak_rss, int status)
+{
+    const char* host = getenv("MYSQLHOST");
+    fprintf(fp, "{\"label\":%s,\"program\":%s,\"mysql_host\":%s,\"records\":%d,\"type_mix\":%s,\"desc_length\":%d,\"info_per_record\":%d,"
+                "\"run\":%d,\"phase\":\"%s\",\"seconds\":%.6f,\"rows\":%lu,\"rows_per_sec\":%.1f,\"peak_rss_kb\":%lu,\"status\":%d}\n",
+        jsonString(opts.label).c_str(), jsonString(program).c_str(), jsonString(host != NULL ? host : "localhost").c_str(),
+        opts.nrecords, jsonString(opts.type_mix).c_str(), opts.desc_length, opts.ninfo,
+        run, phase, seconds, rows, (seconds > 0.0 ? rows / seconds : 0.0), peak_rss, status);
+    fflush(fp);
+}
+
+// run pvdump and wait for its background write to finish
+static bool runPvdump(const BenchOptions& opts, pvdumpRunInfo& info)
+{
+    std::string cmd = std::string("pvdump \"\" \"") + opts.ioc_name + "\" \"" + opts.load_mode + "\"";
+    iocshCmd(cmd.c_str());
+    if (pvdumpWait(opts.timeout) == 1)
+    {
+        fprintf(stderr, "pvdumpBench: timed out waiting for pvdump\n");
+        return false;
+    }
+    return (pvdumpGetRunInfo(&info) == 0);
+}
+
+int main(int argc,char *argv[])
+{
+    BenchOptions opts;
+    std::vector<std::string> types;
+    if (!parseOptions(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!parseTypeMix(opts.type_mix, types))
+    {
+        fprintf(stderr, "pvdumpBench: invalid type mix \"%s\"\n", opts.type_mix.c_str());
+        return 1;
+    }
+    std::string program(argv[0]);
+    size_t sep = program.find_last_of("/\\");
+    if (sep != std::string::npos)
+    {
+        program.erase(0, sep + 1);
+    }
+    if (getenv("EPICS_ROOT") == NULL)
+    {
+        epicsEnvSet("EPICS_ROOT", "."); // pvdump will not run without it
+    }
+    FILE* out = (opts.output_file == "-" ? stdout : fopen(opts.output_file.c_str(), "a"));
+    if (out == NULL)
+    {
+        fprintf(stderr, "pvdumpBench: cannot write \"%s\"\n", opts.output_file.c_str());
+        return 1;
+    }
+
+    epicsTime start = epicsTime::getCurrent();
+    if (!generateDb(opts, types))
+    {
+        return 1;
+    }
+    writeResult(out, opts, program, 0, "generate", epicsTime::getCurrent() - start, opts.nrecords, peakRSS(), 0);
+
+    start = epicsTime::getCurrent();
+    std::string cmd = std::string("dbLoadDatabase \"") + opts.dbd_file + "\"";
+    if (iocshCmd(cmd.c_str()) != 0 || iocshCmd("pvdumpBench_registerRecordDeviceDriver pdbbase") != 0)
+    {
+        fprintf(stderr, "pvdumpBench: cannot load \"%s\"\n", opts.dbd_file.c_str());
+        return 1;
+    }
+    cmd = std::string("dbLoadRecords \"") + opts.db_file + "\"";
+    int status = iocshCmd(cmd.c_str());
+    writeResult(out, opts, program, 0, "load", epicsTime::getCurrent() - start, opts.nrecords, peakRSS(), status);
+    if (!opts.keep_db)
+    {
+        remove(opts.db_file.c_str());
+    }
+    if (status != 0)
+    {
+        return 1;
+    }
+
+    for(int run = 1; run <= opts.repeats && status == 0; ++run)
+    {
+        pvdumpRunInfo info;
+        memset(&info, 0, sizeof(info));
+        if (!runPvdump(opts, info))
+        {
+            status = -1;
+            break;
+        }
+        status = info.status;
+        unsigned long rss = peakRSS();
+        double total = info.scan_time + info.setup_time + info.write_time;
+        writeResult(out, opts, program, run, "dump_pvs", info.scan_time, info.npv, rss, status);
+        writeResult(out, opts, program, run, "setup", info.setup_time, 0, rss, status);
+        writeResult(out, opts, program, run, "delete", info.delete_time, info.npv, rss, status);
+        writeResult(out, opts, program, run, "insert", info.insert_time, info.npv_written + info.ninfo_written, rss, status);
+        writeResult(out, opts, program, run, "iocenv", info.iocenv_time, info.nmacro, rss, status);
+        writeResult(out, opts, program, run, "total", total, info.npv_written + info.ninfo_written + info.nmacro, rss, status);
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    epicsExit(status == 0 ? 0 : 1);
+    return 0;
+}
@@ -0,0 +1,112 @@
+///
+/// @file pvdumpCatalogTest.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Check that a PVCatalog that is only ever added to and removed from, as pv_map is by a server
+/// using pvdumpAddPVs() and pvdumpRemovePVs(), frees the storage of removed and replaced PVs.
+///
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "pvdump_catalog.h"
+
+static const int NBATCH = 200;   // PVs added and removed by each cycle
+static const int NCYCLES = 500;
+
+static std::string pvName(int cycle, int i)
+{
+    char buffer[64];
+    sprintf(buffer, "CATTEST:CYCLE%d:PV%d", cycle, i);
+    return buffer;
+}
+
+// add a batch of PVs with an info field each, then remove them again
+static void addRemoveCycle(PVCatalog& pvs, int cycle)
+{
+    std::vector<std::string> names;
+    for(int i = 0; i < NBATCH; ++i)
+    {
+        names.push_back(pvName(cycle, i));
+    }
+    std::vector<const char*> pnames, types, descs, info_names, values;
+    for(int i = 0; i < NBATCH; ++i)
+    {
+        pnames.push_back(names[i].c_str());
+        types.push_back("ai");
+        descs.push_back("a description long enough to matter");
+        info_names.push_back("archive");
+        values.push_back("VAL 1.0");
+    }
+    pvs.addPVs(NBATCH, &pnames[0], &types[0], &descs[0]);
+    pvs.addInfos(NBATCH, &pnames[0], &info_names[0], &values[0]);
+    pvs.finalize();
+    pvs.removePVs(NBATCH, &pnames[0]);
+}
+
+static void testAddRemove()
+{
+    testDiag("PVs added and removed");
+    PVCatalog pvs;
+    pvs.addPV("CATTEST:KEEP", "ao", "kept throughout");
+    pvs.addInfo("CATTEST:KEEP", "archive", "VAL");
+    for(int cycle = 0; cycle < 10; ++cycle)
+    {
+        addRemoveCycle(pvs, cycle);
+    }
+    const size_t early_usage = pvs.memoryUsage();
+    for(int cycle = 10; cycle < NCYCLES; ++cycle)
+    {
+        addRemoveCycle(pvs, cycle);
+    }
+    testOk(pvs.size() == 1 && pvs.infoCount() == 1, "only the kept PV is left");
+    testOk(pvs.memoryUsage() <= 2 * early_usage, "memory %lu bytes after %d cycles, %lu after 10",
+           static_cast<unsigned long>(pvs.memoryUsage()), NCYCLES, static_cast<unsigned long>(early_usage));
+    testOk(pvs.deadBytes() < 2 * NBATCH * pvName(NCYCLES, NBATCH).size() + 2 * NBATCH * strlen("a description long enough to matter"),
+           "dead bytes %lu bounded", static_cast<unsigned long>(pvs.deadBytes()));
+    size_t i = pvs.find("CATTEST:KEEP");
+    testOk(i != PVCatalog::npos && strcmp(pvs.recordType(i), "ao") == 0 && strcmp(pvs.recordDesc(i), "kept throughout") == 0 &&
+           pvs.findInfo(i, "archive") != NULL && strcmp(pvs.findInfo(i, "archive"), "VAL") == 0, "kept PV intact");
+}
+
+static void testReplace()
+{
+    testDiag("PVs and info fields replaced");
+    PVCatalog pvs;
+    const size_t ncycles = 20000;
+    size_t early_usage = 0;
+    for(size_t cycle = 0; cycle < ncycles; ++cycle)
+    {
+        char value[64];
+        sprintf(value, "value %lu of the info field", static_cast<unsigned long>(cycle));
+        pvs.addInfo("CATTEST:INFO", "archive", value);
+        pvs.addPV("CATTEST:PV", "ai", value);
+        pvs.addInfo("CATTEST:PV", "alarm", value);
+        pvs.finalize();
+        if (cycle == 100)
+        {
+            early_usage = pvs.memoryUsage();
+        }
+    }
+    testOk(pvs.size() == 2 && pvs.infoCount() == 2, "two PVs with an info field each");
+    testOk(pvs.memoryUsage() <= 2 * early_usage, "memory %lu bytes after %lu replacements, %lu after 100",
+           static_cast<unsigned long>(pvs.memoryUsage()), static_cast<unsigned long>(ncycles), static_cast<unsigned long>(early_usage));
+    char last[64];
+    sprintf(last, "value %lu of the info field", static_cast<unsigned long>(ncycles - 1));
+    size_t i = pvs.find("CATTEST:INFO"), j = pvs.find("CATTEST:PV");
+    testOk(i != PVCatalog::npos && strcmp(pvs.findInfo(i, "archive"), last) == 0, "latest info value kept");
+    testOk(j != PVCatalog::npos && strcmp(pvs.recordDesc(j), last) == 0 && strcmp(pvs.findInfo(j, "alarm"), last) == 0,
+           "latest PV kept");
+}
+
+MAIN(pvdumpCatalogTest)
+{
+    testPlan(8);
+    testAddRemove();
+    testReplace();
+    return testDone();
+}
@@ -0,0 +1,335 @@
+///
+/// @file pvdumpMockTest.cpp
+/// @author Freddie Akeroyd, STFC ISIS Facility
+///
+/// Check the SQL pvdump sends for each kind of write. Built against pvdump_mock, which is pvdump
+/// going via the pvdump_mysql interface, and the in-memory pvdump_mysqlmock backend, so it needs
+/// no MySQL server. The mock stores nothing, so the checks are on the statements and parameters
+/// recorded in its call log and on the counts in pvdumpGetRunInfo().
+///
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "envDefs.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "pvdump.h"
+#include "pvdump_mysql_mock.h"
+
+static const char* IOC_NAME = "PVDUMPMOCKTEST";
+static const double WRITE_TIMEOUT = 60.0;
+
+// index of the first call from start whose SQL begins with sql and, if param is not NULL, that was
+// bound param as one of its parameters. -1 if there is none
+static int findCall(int start, const char* sql, const char* param = NULL)
+{
+    const int ncalls = pvdump_mock_call_count();
+    for(int i = start; i < ncalls; ++i)
+    {
+        const char* call_sql = pvdump_mock_call_sql(i);
+        if (call_sql == NULL || strncmp(call_sql, sql, strlen(sql)) != 0)
+        {
+            continue;
+        }
+        if (param == NULL)
+        {
+            return i;
+        }
+        for(int j = 0; j < pvdump_mock_call_nparams(i); ++j)
+        {
+            if (strcmp(pvdump_mock_call_param(i, j), param) == 0)
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// number of calls as findCall() would find, or only those that succeeded
+static int countCalls(const char* sql, const char* param = NULL, bool ok_only = false)
+{
+    int n = 0;
+    for(int i = findCall(0, sql, param); i >= 0; i = findCall(i + 1, sql, param))
+    {
+        if (!ok_only || pvdump_mock_call_ok(i))
+        {
+            ++n;
+        }
+    }
+    return n;
+}
+
+static int countFailedCalls()
+{
+    int n = 0;
+    for(int i = 0; i < pvdump_mock_call_count(); ++i)
+    {
+        if (!pvdump_mock_call_ok(i))
+        {
+            ++n;
+        }
+    }
+    return n;
+}
+
+// live updates are written in the background, so wait for them to appear in the call log
+static int waitForCall(int start, const char* sql, const char* param, double timeout)
+{
+    epicsTime begin(epicsTime::getCurrent());
+    int i;
+    while((i = findCall(start, sql, param)) < 0 && epicsTime::getCurrent() - begin < timeout)
+    {
+        epicsThreadSleep(0.05);
+    }
+    return i;
+}
+
+// clear the call log and do a full pvdump of the PVs added, returns as pvdumpWait()
+static int writePVs(pvdumpRunInfo& info)
+{
+    pvdump_mock_reset();
+    if (pvdumpWritePVs(IOC_NAME) != 0)
+    {
+        return -1;
+    }
+    int status = pvdumpWait(WRITE_TIMEOUT);
+    pvdumpGetRunInfo(&info);
+    return status;
+}
+
+static void addPVs()
+{
+    const char* pvnames[] = { "MOCKTEST:AI", "MOCKTEST:BO", "MOCKTEST:CALC" };
+    const char* record_types[] = { "ai", "bo", "calc" };
+    const char* record_descs[] = { "analogue in", "binary out", "calculation" };
+    pvdumpAddPVs(3, pvnames, record_types, record_descs);
+    pvdumpAddPVInfo("MOCKTEST:AI", "archive", "VAL");
+}
+
+static void testReplace()
+{
+    testDiag("replace write");
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    const std::string delete_own = std::string("DELETE FROM pvs WHERE iocname='") + IOC_NAME + "'";
+    int del = findCall(0, delete_own.c_str());
+    testOk(del >= 0, "our rows from last time deleted");
+    testOk(findCall(0, "DELETE FROM pvs WHERE pvname=?", "MOCKTEST:AI") > del, "then rows of the same name from other IOCs");
+    int ins = findCall(del, "INSERT INTO pvs ", "MOCKTEST:CALC");
+    testOk(ins > del, "then PVs inserted");
+    testOk(findCall(ins, "INSERT INTO pvinfo ", "MOCKTEST:AI") > ins, "then info fields inserted");
+    testOk(findCall(ins, "COMMIT") > ins, "and committed");
+    testOk(info.npv == 3 && info.npv_written == 3 && info.ninfo_written == 1, "wrote %lu of %lu PVs and %lu info fields", info.npv_written, info.npv, info.ninfo_written);
+    testOk(countFailedCalls() == 0, "no failed calls");
+}
+
+static void testUpsert()
+{
+    testDiag("upsert write");
+    epicsEnvSet("PVDUMP_WRITE", "upsert");
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    const std::string delete_own = std::string("DELETE FROM pvs WHERE iocname='") + IOC_NAME + "'";
+    testOk(findCall(0, delete_own.c_str()) < 0, "our rows from last time kept");
+    testOk(findCall(0, "SELECT pvname FROM pvs WHERE iocname=?", IOC_NAME) >= 0, "our existing rows read to find vanished PVs");
+    int ins = findCall(0, "INSERT INTO pvs ", "MOCKTEST:AI");
+    testOk(ins >= 0 && strstr(pvdump_mock_call_sql(ins), "ON DUPLICATE KEY UPDATE") != NULL, "PVs upserted");
+    int info_ins = findCall(0, "INSERT INTO pvinfo ", "MOCKTEST:AI");
+    testOk(info_ins >= 0 && strstr(pvdump_mock_call_sql(info_ins), "ON DUPLICATE KEY UPDATE") != NULL, "info fields upserted");
+    testOk(info.npv_written == 3, "wrote %lu PVs", info.npv_written);
+    testOk(countFailedCalls() == 0, "no failed calls");
+    epicsEnvSet("PVDUMP_WRITE", "replace");
+}
+
+static void testIncremental()
+{
+    testDiag("incremental sync");
+    epicsEnvSet("PVDUMP_SYNC", "incremental");
+    epicsEnvSet("PVDUMP_SNAPSHOT_DIR", ".");
+    remove((std::string("./pvdump_") + IOC_NAME + "_localhost.snap").c_str());
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0 && info.npv_written == 3, "first write without a snapshot is a full write");
+    pvdumpAddPV("MOCKTEST:NEW", "longin", "added");
+    pvdump_mock_reset();
+    pvdump_mock_set_result("SELECT COUNT(*) FROM pvs", "3"); // the database holds what the snapshot says
+    testOk(pvdumpWritePVs(IOC_NAME) == 0 && pvdumpWait(WRITE_TIMEOUT) == 0, "second write succeeded");
+    pvdumpGetRunInfo(&info);
+    const std::string delete_own = std::string("DELETE FROM pvs WHERE iocname='") + IOC_NAME + "'";
+    testOk(findCall(0, delete_own.c_str()) < 0, "our rows from last time kept");
+    testOk(countCalls("INSERT INTO pvs ", "MOCKTEST:NEW") == 1, "added PV inserted");
+    testOk(countCalls("INSERT INTO pvs ", "MOCKTEST:AI") == 0, "unchanged PVs not written");
+    testOk(info.npv == 4 && info.npv_written == 1, "wrote %lu of %lu PVs", info.npv_written, info.npv);
+    testOk(countFailedCalls() == 0, "no failed calls");
+    epicsEnvSet("PVDUMP_SYNC", "full");
+}
+
+static void testShards()
+{
+    testDiag("sharded write");
+    epicsEnvSet("PVDUMP_SHARDS", "2");
+    epicsEnvSet("PVDUMP_BATCH_ROWS", "1");
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    const char* pvnames[] = { "MOCKTEST:AI", "MOCKTEST:BO", "MOCKTEST:CALC", "MOCKTEST:NEW" };
+    int once = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        once += (countCalls("INSERT INTO pvs ", pvnames[i]) == 1 ? 1 : 0);
+    }
+    testOk(once == 4, "each PV inserted once");
+    testOk(countCalls("INSERT INTO pvinfo ", "MOCKTEST:AI") == 1, "info field inserted once");
+    testOk(info.npv_written == 4 && info.ninfo_written == 1, "wrote %lu PVs and %lu info fields", info.npv_written, info.ninfo_written);
+    testOk(countFailedCalls() == 0, "no failed calls");
+    // a commit per PV, so a failed shard has already committed some of its PVs when it is retried
+    epicsEnvSet("PVDUMP_COMMIT_ROWS", "1");
+    epicsEnvSet("PVDUMP_SHARD_ATTEMPTS", "10");
+    pvdump_mock_set_failure("INSERT INTO pvs ", 2);
+    testOk(writePVs(info) == 0, "write with failed inserts succeeded");
+    testOk(countFailedCalls() > 0, "shards were retried");
+    once = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        once += (countCalls("INSERT INTO pvs ", pvnames[i], true) == 1 ? 1 : 0);
+    }
+    testOk(once == 4, "each PV inserted once, retries carry on after the PVs committed");
+    testOk(info.npv_written == 4 && info.ninfo_written == 1, "wrote %lu PVs and %lu info fields", info.npv_written, info.ninfo_written);
+    pvdump_mock_set_failure(NULL, 0);
+    epicsEnvSet("PVDUMP_COMMIT_ROWS", "5000");
+    epicsEnvSet("PVDUMP_SHARD_ATTEMPTS", "3");
+    epicsEnvSet("PVDUMP_SHARDS", "1");
+    epicsEnvSet("PVDUMP_BATCH_ROWS", "500");
+}
+
+static void testCleanupRetry()
+{
+    testDiag("row cleanup after a deadlock");
+    // there are 4 PVs, so the 6th delete is the second of the second write
+    pvdump_mock_reset();
+    pvdump_mock_set_failure_code(1213, "40001");
+    pvdump_mock_set_failure("DELETE FROM pvs WHERE pvname=?", 6);
+    pvdumpRunInfo info;
+    testOk(pvdumpWritePVs(IOC_NAME) == 0 && pvdumpWait(WRITE_TIMEOUT) == 0, "first write succeeded");
+    testOk(pvdumpWritePVs(IOC_NAME) == 0 && pvdumpWait(WRITE_TIMEOUT) == 0, "write with a deadlock succeeded");
+    pvdumpGetRunInfo(&info);
+    testOk(countFailedCalls() == 1 && info.lock_retries == 1, "cleanup retried after the deadlock");
+    testOk(countCalls("DELETE FROM pvs WHERE pvname=?", "MOCKTEST:AI", true) == 3, "and all its deletes made again");
+    pvdump_mock_set_failure(NULL, 0);
+    pvdump_mock_set_failure_code(0, NULL);
+}
+
+// index of the first LOAD DATA LOCAL INFILE into table from start, -1 if there is none
+static int findLoad(int start, const char* table)
+{
+    const std::string into = std::string("' INTO TABLE ") + table + " (";
+    for(int i = findCall(start, "LOAD DATA LOCAL INFILE "); i >= 0; i = findCall(i + 1, "LOAD DATA LOCAL INFILE "))
+    {
+        if (strstr(pvdump_mock_call_sql(i), into.c_str()) != NULL)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void testBulkLoad()
+{
+    testDiag("bulk load");
+    // the pooled connection from the writes above was made without local infile
+    pvdumpSetLoadMode("bulk");
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    int load = findLoad(0, "pvs");
+    testOk(load >= 0 && pvdump_mock_call_ok(load), "PVs loaded on a connection allowing local infile");
+    testOk(findLoad(load, "pvinfo") > load && findLoad(0, "iocenv") > load, "then info fields and iocenv");
+    testOk(findCall(0, "INSERT INTO pvs ") < 0 && findCall(0, "INSERT INTO iocenv ") < 0, "without INSERT");
+    testOk(info.npv_written == info.npv && info.ninfo_written == info.ninfo, "wrote %lu of %lu PVs and %lu of %lu info fields",
+           info.npv_written, info.npv, info.ninfo_written, info.ninfo);
+    testOk(countFailedCalls() == 0, "no failed calls");
+    // as if a row of each file hit a duplicate key
+    pvdump_mock_reset();
+    pvdump_mock_set_result("SELECT ROW_COUNT()", "1");
+    testOk(pvdumpWritePVs(IOC_NAME) == 0 && pvdumpWait(WRITE_TIMEOUT) == 0, "write with rows skipped succeeded");
+    pvdumpGetRunInfo(&info);
+    load = findLoad(0, "pvs");
+    testOk(load >= 0 && findCall(load, "ROLLBACK") > load, "PV load rolled back");
+    testOk(findCall(load, "INSERT INTO pvs ", "MOCKTEST:AI") > load, "and PVs inserted instead");
+    testOk(findCall(findLoad(0, "iocenv"), "INSERT INTO iocenv ") > 0, "iocenv inserted instead");
+    testOk(info.npv_written == info.npv, "wrote %lu of %lu PVs", info.npv_written, info.npv);
+    pvdumpSetLoadMode(""); // back to PVDUMP_LOAD
+}
+
+static void testSpoolFailure()
+{
+    testDiag("spool failure");
+    // the spool file cannot be created in a directory that does not exist
+    epicsEnvSet("PVDUMP_SPOOL", "on");
+    epicsEnvSet("PVDUMP_SPOOL_DIR", "./no_such_directory");
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    testOk(findCall(0, "INSERT INTO pvs ", "MOCKTEST:AI") >= 0 && info.npv_written == info.npv, "PVs written to MySQL directly");
+    epicsEnvSet("PVDUMP_SPOOL", "off");
+}
+
+static void testLiveUpdate()
+{
+    testDiag("live updates");
+    pvdumpSetLiveInterval(0.1);
+    pvdumpRunInfo info;
+    testOk(writePVs(info) == 0, "write succeeded");
+    pvdump_mock_reset();
+    pvdumpAddPV("MOCKTEST:LIVE", "ao", "added live");
+    int ins = waitForCall(0, "INSERT INTO pvs ", "MOCKTEST:LIVE", WRITE_TIMEOUT);
+    testOk(ins >= 0, "added PV inserted");
+    testOk(waitForCall(ins, "COMMIT", NULL, WRITE_TIMEOUT) > ins, "and committed");
+    testOk(countCalls("INSERT INTO pvs ", "MOCKTEST:AI") == 0, "unchanged PVs not written");
+    pvdump_mock_reset();
+    const char* removed[] = { "MOCKTEST:LIVE" };
+    pvdumpRemovePVs(1, removed);
+    int del = waitForCall(0, "DELETE FROM pvs WHERE pvname", "MOCKTEST:LIVE", WRITE_TIMEOUT);
+    testOk(del >= 0 && findCall(del, "DELETE FROM pvs WHERE pvname", IOC_NAME) == del, "removed PV deleted");
+    testOk(waitForCall(del, "COMMIT", NULL, WRITE_TIMEOUT) > del && countCalls("INSERT INTO pvs ", "MOCKTEST:LIVE") == 0, "and not inserted");
+    // our row of a PV that is already there has to go before it is inserted again
+    pvdump_mock_reset();
+    pvdumpAddPVInfo("MOCKTEST:BO", "archive", "VAL");
+    int info_ins = waitForCall(0, "INSERT INTO pvinfo ", "MOCKTEST:BO", WRITE_TIMEOUT);
+    testOk(info_ins >= 0, "info field added to an existing PV inserted");
+    del = findCall(0, "DELETE FROM pvs WHERE pvname", "MOCKTEST:BO");
+    ins = findCall(0, "INSERT INTO pvs ", "MOCKTEST:BO");
+    testOk(del >= 0 && del < ins && strstr(pvdump_mock_call_sql(del), "iocname=?") != NULL, "after our existing row of the PV was deleted");
+    testOk(waitForCall(del, "COMMIT", NULL, WRITE_TIMEOUT) > info_ins, "in the same transaction");
+    // a name we never added, e.g. a record of the IOC, is not ours to delete
+    pvdump_mock_reset();
+    const char* unknown[] = { "MOCKTEST:UNKNOWN" };
+    testOk(pvdumpRemovePVs(1, unknown) == 0, "removing a PV that was not added removes none");
+    pvdumpAddPV("MOCKTEST:LIVE2", "ao", "added live");
+    ins = waitForCall(0, "INSERT INTO pvs ", "MOCKTEST:LIVE2", WRITE_TIMEOUT);
+    testOk(ins >= 0 && waitForCall(ins, "COMMIT", NULL, WRITE_TIMEOUT) > ins && countCalls("DELETE FROM pvs", "MOCKTEST:UNKNOWN") == 0,
+           "and its database rows are left alone");
+    testOk(countFailedCalls() == 0, "no failed calls");
+    pvdumpSetLiveInterval(0.0);
+}
+
+MAIN(pvdumpMockTest)
+{
+    testPlan(60);
+    if (getenv("EPICS_ROOT") == NULL)
+    {
+        epicsEnvSet("EPICS_ROOT", "."); // pvdump will not run without it
+    }
+    addPVs();
+    testReplace();
+    testUpsert();
+    testIncremental();
+    testShards();
+    testCleanupRetry();
+    testBulkLoad();
+    testSpoolFailure();
+    testLiveUpdate();
+    return testDone();
+}